@@ -35,6 +35,9 @@ main:
 	MOV R0, 0
 	ST R0, [SP]
 .loop:
+	; The last list must be done before it is rewritten and its buffer presented
+	BL GUWaitIdle
+
 	LD R0, [SP]
 	EOR R1, R0, 1
 	ST R1, [SP]
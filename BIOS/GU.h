@@ -34,3 +34,14 @@ GUSendCommandList:
 	ST R0, [R1]
 
 	RET
+
+; Command lists run asynchronously, waits until the last kicked one completed
+GUWaitIdle:
+	IMM32 R0, GU_QUEUE_SEQ
+.loop:
+	LD R1, [R0]
+	LD R2, [R0, 4]
+	CMP R1, R2
+	BNE .loop
+
+	RET
@@ -8,6 +8,7 @@ DMA_BASE =		IO_BASE | 0x01000
 PAD_BASE =		IO_BASE | 0x02000
 USI_BASE =		IO_BASE | 0x03000
 DISPLAY_BASE =	IO_BASE | 0x04000
+SPU_BASE =		IO_BASE | 0x05000
 GU_BASE =       IO_BASE | 0x10000
 
 ; IRQ Registers
@@ -84,6 +85,7 @@ DMA_WAIT_ON_MASK =	DMA_BASE | 0x108
 IO_PAD_MAIN_BUTTONS =	PAD_BASE | 0x000
 IO_PAD_MAIN_STICKS =	PAD_BASE | 0x004
 IO_PAD_MAIN_STATUS =	PAD_BASE | 0x008
+IO_PAD_MAIN_CTR =	PAD_BASE | 0x00C
 
 
 ; Display Registers
@@ -124,7 +126,8 @@ GU_ID =			GU_BASE | 0x000C
 ; [31] Start Execution
 GU_QUEUE_CTR =		GU_BASE | 0x0010
 ; Queue State
-; [0 - 31] Queue State
+; [0 - 7] Queue State
+; [8 - 31] Low bits of the sequence the state belongs to
 GU_QUEUE_STATUS =	GU_BASE | 0x0014
 
 ; Queue Command List Address
@@ -133,4 +136,10 @@ GU_QUEUE_ADDR =		GU_BASE | 0x0018
 ; Queue Command Buffer Length
 ; [0 - 31] Buffer Length
 GU_QUEUE_LEN =		GU_BASE | 0x001C
+; Queue Sequence
+; [0 - 31] Sequence of the last kicked command list
+GU_QUEUE_SEQ =		GU_BASE | 0x0020
+; Queue Fence
+; [0 - 31] Sequence of the last completed command list
+GU_QUEUE_FENCE =	GU_BASE | 0x0024
 
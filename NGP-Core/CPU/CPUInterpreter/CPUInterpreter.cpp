@@ -8,6 +8,7 @@
 
 #include "FileFormat/ISA.h"
 #include "Memory/Bus.h"
+#include "Memory/MemoryProfiler.h"
 #include "Emulator.h"
 
 #include <cstdio>
@@ -206,6 +207,49 @@ static FORCE_INLINE void memory_pair_write_v(CPUInterpreter& core, const u8 src1
     HANDLE_SIMD_WRITE(core, src2, qw, Bus::write_qword, address + 16);
 }
 
+// Exclusive/Atomic
+static FORCE_INLINE void ldx(CPUInterpreter& core, const u8 dest, const u8 base, const u8)
+{
+    const VirtualAddress address = core.list[base];
+    Word value;
+    // The fault already cleared the monitor
+    if (!Bus::atomic_load_word(address, value))
+        return;
+
+    core.exclusive_address = address;
+    core.exclusive_value = value;
+    core.exclusive_valid = true;
+    core.list[dest] = (dest != CPUCore::ZeroRegister) * value;
+}
+
+static FORCE_INLINE void stx(CPUInterpreter& core, const u8 dest, const u8 base, const u8 src)
+{
+    const VirtualAddress address = core.list[base];
+    bool stored = false;
+
+    if (core.exclusive_valid && core.exclusive_address == address)
+    {
+        Word expected = core.exclusive_value;
+        stored = Bus::atomic_compare_exchange_word(address, expected, core.list[src]);
+    }
+
+    core.exclusive_valid = false;
+    core.list[dest] = (dest != CPUCore::ZeroRegister) * !stored;
+}
+
+static FORCE_INLINE void swp(CPUInterpreter& core, const u8 dest, const u8 base, const u8 src)
+{
+    const Word old = Bus::atomic_swap_word(core.list[base], core.list[src]);
+    core.list[dest] = (dest != CPUCore::ZeroRegister) * old;
+}
+
+static FORCE_INLINE void cas(CPUInterpreter& core, const u8 dest, const u8 base, const u8 src)
+{
+    Word expected = core.list[dest];
+    Bus::atomic_compare_exchange_word(core.list[base], expected, core.list[src]);
+    core.list[dest] = (dest != CPUCore::ZeroRegister) * expected;
+}
+
 // ExtendedAlu
 static FORCE_INLINE void madd(CPUInterpreter& core, const u8 dest, const u8 src1, const u8 src2, const u8 src3)
 {
@@ -529,6 +573,10 @@ static FORCE_INLINE void _3op(CPUInterpreter& core, const u32 inst)
         CASE_SIMD_R(NGP_LD_V, qw, Bus::read_qword);
         CASE_SIMD_W(NGP_ST_S, w, Bus::write_word);
         CASE_SIMD_W(NGP_ST_V, qw, Bus::write_qword);
+        CASE(NGP_LDX, ldx);
+        CASE(NGP_STX, stx);
+        CASE(NGP_SWP, swp);
+        CASE(NGP_CAS, cas);
     default:
         break;
     }
@@ -891,6 +939,7 @@ static FORCE_INLINE void fp_4op(CPUInterpreter& core, const u32 inst)
 void CPUInterpreter::initialize()
 {
     pc = 0;
+    exclusive_valid = false;
     handle_pc_change();
 }
 
@@ -1034,6 +1083,10 @@ void CPUInterpreter::handle_pc_change()
 
 Word CPUInterpreter::fetch_next_inst()
 {
+#if NGP_MEMORY_PROFILER
+    MemoryProfiler::record(pc, MemoryProfiler::Execute);
+#endif // NGP_MEMORY_PROFILER
+
     const Word page_index = Bus::get_page_index(pc);
     if (pc_page_index == page_index) [[likely]]
         return pc_page_addr[pc_page_offset];
@@ -1047,6 +1100,8 @@ Word CPUInterpreter::fetch_next_inst()
 
 void CPUInterpreter::make_exception(ExceptionCode code, VirtualAddress vec_offset, u16 comment)
 {
+    exclusive_valid = false;
+
     switch (code)
     {
     case SupervisorException:
@@ -1099,6 +1154,7 @@ void CPUInterpreter::return_exception()
 
     psr = last_psr;
     pc = target_pc;
+    exclusive_valid = false;
     handle_pc_change();
 }
 
@@ -60,6 +60,12 @@ struct alignas(64) CPUInterpreter : CPUCore
     Word pc_page_offset;
     const Word* pc_page_addr;
 
+    // Exclusive monitor, STX succeeds only if the word still holds the
+    // value observed by the last LDX of the same address.
+    VirtualAddress exclusive_address;
+    Word exclusive_value;
+    bool exclusive_valid;
+
     void initialize() override;
     void shutdown() override;
 
@@ -0,0 +1,173 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#pragma once
+#include "Core/Header.h"
+
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+// Bulk operations on host memory. SSE2 is always available on x64, AVX2 is
+// used when the build enables it (NGP_ENABLE_AVX2).
+struct HostMemory
+{
+    // Copies from this size bypass the cache on the destination
+    static constexpr usize StreamThreshold = KB(32);
+
+    // Repeats a byte or half pattern over a whole word
+    static constexpr Word splat_pattern(Word value, Word pattern_size)
+    {
+        switch (pattern_size)
+        {
+        case 1: return (value & 0xFF) * 0x0101'0101U;
+        case 2: return (value & 0xFFFF) * 0x0001'0001U;
+        default: return value;
+        }
+    }
+
+    // Fills size bytes with a repeated word, the pattern starts at dst
+    static void fill_word(void* dst, Word pattern, usize size)
+    {
+        u8* out = (u8*)dst;
+
+#if defined(__AVX2__)
+        const __m256i wide = _mm256_set1_epi32(i32(pattern));
+        while (size >= 128)
+        {
+            _mm256_storeu_si256((__m256i*)(out + 0), wide);
+            _mm256_storeu_si256((__m256i*)(out + 32), wide);
+            _mm256_storeu_si256((__m256i*)(out + 64), wide);
+            _mm256_storeu_si256((__m256i*)(out + 96), wide);
+            out += 128;
+            size -= 128;
+        }
+#endif // __AVX2__
+
+        const __m128i value = _mm_set1_epi32(i32(pattern));
+        while (size >= 64)
+        {
+            _mm_storeu_si128((__m128i*)(out + 0), value);
+            _mm_storeu_si128((__m128i*)(out + 16), value);
+            _mm_storeu_si128((__m128i*)(out + 32), value);
+            _mm_storeu_si128((__m128i*)(out + 48), value);
+            out += 64;
+            size -= 64;
+        }
+
+        while (size >= 16)
+        {
+            _mm_storeu_si128((__m128i*)out, value);
+            out += 16;
+            size -= 16;
+        }
+
+        // The pattern keeps its phase, every consumed block is a multiple of 4 bytes
+        u8 tail[16];
+        _mm_storeu_si128((__m128i*)tail, value);
+        std::memcpy(out, tail, size);
+    }
+
+    // Fill with non-temporal stores, for large ranges the host will not read back soon
+    static void stream_fill_word(void* dst, Word pattern, usize size)
+    {
+        u8* out = (u8*)dst;
+
+        // Align the destination, the pattern keeps its phase when the head is whole words
+        const usize head = std::min(size, (16 - (usize(out) & 15)) & 15);
+        if ((head & 3) != 0)
+        {
+            fill_word(out, pattern, size);
+            return;
+        }
+
+        fill_word(out, pattern, head);
+        out += head;
+        size -= head;
+
+        const __m128i value = _mm_set1_epi32(i32(pattern));
+        while (size >= 64)
+        {
+            _mm_stream_si128((__m128i*)(out + 0), value);
+            _mm_stream_si128((__m128i*)(out + 16), value);
+            _mm_stream_si128((__m128i*)(out + 32), value);
+            _mm_stream_si128((__m128i*)(out + 48), value);
+            out += 64;
+            size -= 64;
+        }
+
+        // Streaming stores are weakly ordered
+        _mm_sfence();
+        fill_word(out, pattern, size);
+    }
+
+    // Copy with non-temporal stores, for data the host will not read back soon.
+    // The ranges must not overlap.
+    static void stream_copy(void* dst, const void* src, usize size)
+    {
+        u8* out = (u8*)dst;
+        const u8* in = (const u8*)src;
+
+#if defined(__AVX2__)
+        constexpr usize Alignment = 32;
+#else
+        constexpr usize Alignment = 16;
+#endif // __AVX2__
+
+        // Align the destination, streaming stores require it
+        const usize head = std::min(size, (Alignment - (usize(out) & (Alignment - 1))) & (Alignment - 1));
+        std::memcpy(out, in, head);
+        out += head;
+        in += head;
+        size -= head;
+
+#if defined(__AVX2__)
+        while (size >= 128)
+        {
+            const __m256i a = _mm256_loadu_si256((const __m256i*)(in + 0));
+            const __m256i b = _mm256_loadu_si256((const __m256i*)(in + 32));
+            const __m256i c = _mm256_loadu_si256((const __m256i*)(in + 64));
+            const __m256i d = _mm256_loadu_si256((const __m256i*)(in + 96));
+            _mm256_stream_si256((__m256i*)(out + 0), a);
+            _mm256_stream_si256((__m256i*)(out + 32), b);
+            _mm256_stream_si256((__m256i*)(out + 64), c);
+            _mm256_stream_si256((__m256i*)(out + 96), d);
+            in += 128;
+            out += 128;
+            size -= 128;
+        }
+#endif // __AVX2__
+
+        while (size >= 64)
+        {
+            const __m128i a = _mm_loadu_si128((const __m128i*)(in + 0));
+            const __m128i b = _mm_loadu_si128((const __m128i*)(in + 16));
+            const __m128i c = _mm_loadu_si128((const __m128i*)(in + 32));
+            const __m128i d = _mm_loadu_si128((const __m128i*)(in + 48));
+            _mm_stream_si128((__m128i*)(out + 0), a);
+            _mm_stream_si128((__m128i*)(out + 16), b);
+            _mm_stream_si128((__m128i*)(out + 32), c);
+            _mm_stream_si128((__m128i*)(out + 48), d);
+            in += 64;
+            out += 64;
+            size -= 64;
+        }
+
+        // Streaming stores are weakly ordered
+        _mm_sfence();
+        std::memcpy(out, in, size);
+    }
+
+    // Picks the streaming copy for large non overlapping ranges
+    static void copy(void* dst, const void* src, usize size)
+    {
+        const bool overlap = (u8*)dst < (const u8*)src + size && (const u8*)src < (u8*)dst + size;
+        if (size >= StreamThreshold && !overlap)
+            stream_copy(dst, src, size);
+        else
+            std::memmove(dst, src, size);
+    }
+};
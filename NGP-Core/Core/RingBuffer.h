@@ -0,0 +1,105 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#pragma once
+#include "Core/Header.h"
+
+#include <atomic>
+
+// Lock-free ring for any number of producer threads and one consumer thread.
+// Every slot carries the position it is ready for, a producer reserves the
+// write position with a compare exchange and publishes the slot after
+// writing it. Capacity must be a power of two.
+template<typename T, usize Capacity>
+struct RingBuffer
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static constexpr usize Mask = Capacity - 1;
+
+    RingBuffer()
+    {
+        for (usize i = 0; i < Capacity; i++)
+        {
+            slots[i].position.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Producer
+    bool push(const T& value)
+    {
+        return push_with([&](usize) { return value; });
+    }
+
+    // Producer, make(position) builds the item once its slot is reserved and
+    // before the consumer can see it. Positions count every push of the ring.
+    template<typename Fn>
+    bool push_with(Fn&& make)
+    {
+        usize tail = write_index.load(std::memory_order_relaxed);
+        while (true)
+        {
+            const usize position = slots[tail & Mask].position.load(std::memory_order_acquire);
+            // The consumer didn't free the slot yet, the ring is full
+            if (isize(position - tail) < 0)
+                return false;
+
+            if (position == tail)
+            {
+                if (write_index.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else
+            {
+                // Another producer took this position
+                tail = write_index.load(std::memory_order_relaxed);
+            }
+        }
+
+        Slot& slot = slots[tail & Mask];
+        slot.value = make(tail);
+        slot.position.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer
+    bool pop(T& value)
+    {
+        const usize head = read_index.load(std::memory_order_relaxed);
+        Slot& slot = slots[head & Mask];
+        if (slot.position.load(std::memory_order_acquire) != head + 1)
+            return false;
+
+        value = slot.value;
+        slot.position.store(head + Capacity, std::memory_order_release);
+        read_index.store(head + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer
+    bool empty() const
+    {
+        const usize head = read_index.load(std::memory_order_relaxed);
+        return slots[head & Mask].position.load(std::memory_order_acquire) != head + 1;
+    }
+
+    // Consumer, drops every published item
+    void clear()
+    {
+        T value;
+        while (pop(value)) {}
+    }
+
+    struct Slot
+    {
+        std::atomic<usize> position;
+        T value;
+    };
+
+    // Each index in its own cache line, so both sides don't share one
+    alignas(64) std::atomic<usize> write_index = 0;
+    alignas(64) std::atomic<usize> read_index = 0;
+    Slot slots[Capacity];
+};
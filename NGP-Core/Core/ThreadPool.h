@@ -0,0 +1,127 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#pragma once
+#include "Core/Header.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running one parallel loop at a time.
+// The thread that starts the loop works on it too and returns when every
+// index is done.
+struct ThreadPool
+{
+    using TaskFn = void(*)(void* user, u32 index);
+
+    void start(u32 worker_count)
+    {
+        exit = false;
+        // Workers wake on any change after this point, even one before they run
+        const u32 start_generation = generation.load(std::memory_order_acquire);
+        for (u32 i = 0; i < worker_count; i++)
+        {
+            workers.emplace_back(&ThreadPool::worker, this, start_generation);
+        }
+    }
+
+    void stop()
+    {
+        exit.store(true, std::memory_order_release);
+        generation.fetch_add(1, std::memory_order_release);
+        generation.notify_all();
+
+        for (auto& thread : workers)
+        {
+            thread.join();
+        }
+        workers.clear();
+    }
+
+    void parallel_for(u32 count, TaskFn fn, void* user)
+    {
+        if (count == 0)
+            return;
+
+        task = fn;
+        task_user = user;
+        task_count.store(count, std::memory_order_relaxed);
+        done_count.store(0, std::memory_order_relaxed);
+        // A new loop tag, a worker still holding a claim of an older loop
+        // fails its compare exchange even when the index matches
+        loop_tag++;
+        next_claim.store(u64(loop_tag) << 32, std::memory_order_release);
+
+        if (count > 1 && !workers.empty())
+        {
+            generation.fetch_add(1, std::memory_order_release);
+            generation.notify_all();
+        }
+
+        run_tasks();
+
+        u32 done = done_count.load(std::memory_order_acquire);
+        while (done < count)
+        {
+            done_count.wait(done, std::memory_order_acquire);
+            done = done_count.load(std::memory_order_acquire);
+        }
+    }
+
+    u32 get_worker_count() const { return u32(workers.size()); }
+
+    void run_tasks()
+    {
+        // [0 - 31] Next index, [32 - 63] Tag of the loop it belongs to
+        u64 claim = next_claim.load(std::memory_order_acquire);
+        while (u32(claim) < task_count.load(std::memory_order_acquire))
+        {
+            if (!next_claim.compare_exchange_weak(claim, claim + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                continue;
+
+            // The count read above may belong to another loop, the claim
+            // synchronized with the start of its own
+            const u32 index = u32(claim);
+            const u32 count = task_count.load(std::memory_order_relaxed);
+            if (index >= count)
+                return;
+
+            task(task_user, index);
+            if (done_count.fetch_add(1, std::memory_order_acq_rel) + 1 == count)
+            {
+                done_count.notify_all();
+            }
+
+            claim = next_claim.load(std::memory_order_acquire);
+        }
+    }
+
+    void worker(u32 seen)
+    {
+        while (true)
+        {
+            generation.wait(seen, std::memory_order_acquire);
+            seen = generation.load(std::memory_order_acquire);
+            if (exit.load(std::memory_order_acquire))
+                return;
+
+            run_tasks();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::atomic<u32> generation = 0;
+    std::atomic<bool> exit = false;
+
+    TaskFn task = nullptr;
+    void* task_user = nullptr;
+    std::atomic<u32> task_count = 0;
+    std::atomic<u64> next_claim = 0;
+    // Owned by the thread that starts the loops
+    u32 loop_tag = 0;
+    std::atomic<u32> done_count = 0;
+};
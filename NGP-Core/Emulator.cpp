@@ -7,13 +7,16 @@
 #include "Emulator.h"
 
 #include "IO/IO.h"
+#include "IO/Pad/Pad.h"
 #include "Memory/Bus.h"
+#include "Memory/MemoryProfiler.h"
 #include "Platform/Header.h"
 #include "Platform/OS.h"
 #include "Platform/Time.h"
 #include "Video/GUDevice.h"
 #include "Video/Window.h"
 
+#include <csignal>
 #include <cstdlib>
 #include <cstdio>
 #include <chrono>
@@ -132,7 +135,7 @@ void Emulator::initialize(const EmulatorConfig& config)
     Time::initialize();
 
     Bus::initialize();
-    if (!Bus::load_bios(bios_file))
+    if (!Bus::load_bios(bios_file, map_bios_file))
     {
         printf("error: invalid bios file '%s'\n", bios_file);
         std::exit(-1);
@@ -144,6 +147,11 @@ void Emulator::initialize(const EmulatorConfig& config)
     Window::initialize(Window::DefaultWindowWidth, Window::DefaultWindowHeight);
     GUDevice::initialize(GUDevice::VGU);
 
+#if NGP_MEMORY_PROFILER && !defined(_WIN32)
+    // The Win32 window asks for a dump with F9
+    std::signal(SIGUSR1, [](int) { MemoryProfiler::request_dump(); });
+#endif // NGP_MEMORY_PROFILER && !defined(_WIN32)
+
     auto thread_count = std::thread::hardware_concurrency();
 }
 
@@ -152,6 +160,13 @@ void Emulator::shutdown()
     end_cores();
     print_cores();
 
+#if NGP_MEMORY_PROFILER
+    if (MemoryProfiler::dump_path)
+    {
+        MemoryProfiler::dump(MemoryProfiler::dump_path);
+    }
+#endif // NGP_MEMORY_PROFILER
+
     for (auto& core : cores)
     {
         delete core.core;
@@ -242,8 +257,19 @@ void Emulator::loop()
 
         Window::update();
         IO::dispatch();
+
+#if NGP_MEMORY_PROFILER
+        if (MemoryProfiler::dump_requested.exchange(false, std::memory_order_relaxed))
+        {
+            const char* path = MemoryProfiler::dump_path ? MemoryProfiler::dump_path : MemoryProfiler::DefaultDumpPath;
+            if (MemoryProfiler::dump(path))
+                printf("memory profile written to '%s'\n", path);
+        }
+#endif // NGP_MEMORY_PROFILER
+
         if (GUDevice::present(false))
         {
+            Pad::frame_presented();
             fps++;
         }
         elapsed += Time::get_time() - start;
@@ -266,7 +292,25 @@ void Emulator::run()
     loop();
 }
 
-void Emulator::handle_readwrite_interrupt(VirtualAddress, bool)
+void Emulator::handle_readwrite_interrupt(VirtualAddress address, bool read)
 {
+    if (watch_callback)
+    {
+        watch_callback(address, read);
+        return;
+    }
+
+    // Accesses from device threads have no core to trap
+    if (!local_core)
+    {
+        printf("watchpoint: %s at 0x%08X by a device\n", read ? "read" : "write", address);
+        return;
+    }
+
+    printf(
+        "watchpoint: %s at 0x%08X, PC: 0x%08X\n",
+        read ? "read" : "write", address, local_core->get_core().get_pc()
+    );
+    local_core->get_core().external_handle_exception(CPUCore::BreakpointException, CPUCore::CommentNone, address);
 }
 
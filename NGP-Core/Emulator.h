@@ -50,9 +50,14 @@ struct Emulator
 
     static inline u64 frames_per_second = 60;
     static inline const char* bios_file = DefaultBIOSPath;
+    static inline bool map_bios_file = false;
     static inline bool allow_continue = false;
     static inline bool pending_restart = false;
 
+    // Called on a watchpoint hit instead of raising a BreakpointException on the core
+    using WatchCallback = void(*)(VirtualAddress address, bool read);
+    static inline WatchCallback watch_callback = nullptr;
+
     static void initialize(const EmulatorConfig& config);
     static void shutdown();
 
@@ -180,6 +180,23 @@ enum NGP3OP
     //ST[S/D/Q] Rfs, [Rb, Ri]
     NGP_ST_S = 0x2A,
     NGP_ST_V = 0x2B,
+
+    // Exclusive and atomic word accesses, Rb must be word aligned
+    // Rss = R[Src2]
+
+    // LDX Rd, [Rb]
+    // Load a word and mark its address in the core exclusive monitor
+    NGP_LDX = 0x2C,
+    // STX Rd, Rss, [Rb]
+    // Store Rss if [Rb] is still held by the exclusive monitor,
+    // Rd = 0 on success, 1 on failure
+    NGP_STX = 0x2D,
+    // SWP Rd, Rss, [Rb]
+    // Rd = [Rb], [Rb] = Rss
+    NGP_SWP = 0x2E,
+    // CAS Rd, Rss, [Rb]
+    // if [Rb] == Rd then [Rb] = Rss, Rd = old [Rb]
+    NGP_CAS = 0x2F,
 };
 
 // Binary (FP)
@@ -6,101 +6,358 @@
 /******************************************************/
 #include "IO/DMA/DMA.h"
 
-#include "Video/GUDevice.h"
+#include "CPU/CPUCore.h"
+#include "Core/HostMemory.h"
+#include "IO/IRQ/IRQ.h"
+#include "IO/RegisterMap.h"
+#include "IO/SPU/SPU.h"
+#include "IO/USI/USI.h"
 #include "Memory/Bus.h"
+#include "Platform/OS.h"
+#include "Platform/Time.h"
+#include "Video/GUDevice.h"
 
+#include <algorithm>
+#include <cstdio>
 
-static inline void dma_channel_write(DMA::DMAChannel channel, u8 reg, Word value)
+
+static FORCE_INLINE std::atomic_ref<Word> dma_reg(Word& reg)
 {
-    DMA::DMAChannelInfo& chn = DMA::get_registers().channels[channel];
-    chn.raw_regs[reg] = value;
+    return std::atomic_ref<Word>(reg);
 }
 
-static inline void dma_set_irq_mask(Word value)
+static constexpr IO::RegisterInfo dma_register_map[] =
+{
+    { DMA::DMA_CHANNELS_START, DMA::DMA_CHANNELS_MAX * sizeof(DMA::DMAChannelInfo), IO::REG_READ_WRITE, &DMA::write_channel },
+    { DMA::DMA_IRQ_MASK, 4, IO::REG_READ_WRITE, nullptr },
+    { DMA::DMA_IRQ_STATUS, 4, IO::REG_READ_WRITE, nullptr },
+    { DMA::DMA_WAIT_ON_MASK, 4, IO::REG_READ_WRITE, nullptr },
+};
+
+static constexpr IO::RegisterTable dma_registers = IO::make_register_table(dma_register_map);
+
+IO::IODevice DMA::get_io_device()
 {
-    DMA::get_registers().irq_mask = value;
+    return IO::make_io_device<IO::DMA_BASE, dma_registers>(&DMA::initialize, &DMA::shutdown, []() {});
 }
 
-static inline void dma_set_irq_status(Word value)
+void DMA::initialize()
 {
-    DMA::get_registers().irq_status = value;
+    dma_exit = false;
+    kicks.clear();
+    dma_thread = std::thread(&DMA::worker);
 }
 
-static inline void dma_wait_on(Word value)
+void DMA::shutdown()
 {
-    DMA::get_registers().wait_on_mask = value;
+    dma_exit = true;
+    kick_counter.fetch_add(1, std::memory_order_release);
+    kick_counter.notify_one();
+    dma_thread.join();
 }
 
-IO::IODevice DMA::get_io_device()
+// Highest priority busy channel, round robin between equal priorities
+static i32 dma_select_channel()
 {
-    return IO::IODevice
+    i32 selected = -1;
+    i32 best_priority = -1;
+
+    for (Word i = 1; i <= DMA::DMA_CHANNELS_MAX; i++)
     {
-        .base_address = IO::DMA_BASE,
+        const Word ch = (DMA::last_channel + i) % DMA::DMA_CHANNELS_MAX;
+        const Word ctr = dma_reg(DMA::get_registers().channels[ch].ctr).load(std::memory_order_acquire);
+        if (DMA::channel_states[ch].armed && (ctr & DMA::DMA_BUSY) && i32(DMA::get_priority(ctr)) > best_priority)
+        {
+            selected = i32(ch);
+            best_priority = DMA::get_priority(ctr);
+        }
+    }
 
-        .initialize = &DMA::initialize,
-        .shutdown = &DMA::shutdown,
-        .dispatch = &DMA::dispatch,
+    return selected;
+}
 
-        .read_byte = [](VirtualAddress) -> u8 { return 0; },
-        .read_half = [](VirtualAddress) -> u16 { return 0; },
-        .read_word = [](VirtualAddress) -> Word { return 0; },
-        .read_dword = [](VirtualAddress) -> DWord { return 0; },
-        .read_qword = [](VirtualAddress) -> QWord { return QWord(); },
+static void dma_ram_transfer(const DMA::DMAChannelInfo& info, Word offset, Word bytes)
+{
+    bool valid;
+    if (info.ctr & DMA::DMA_FILL_MODE_U32)
+    {
+        const Word pattern = HostMemory::splat_pattern(info.src, DMA::get_step_size(DMA::get_step(info.ctr)));
+        valid = Bus::fill_range_word(info.dst + offset, pattern, bytes);
+    }
+    else
+    {
+        valid = Bus::copy_range(info.dst + offset, info.src + offset, bytes);
+    }
 
-        .write_byte = [](VirtualAddress, u8) {},
-        .write_half = [](VirtualAddress, u16) {},
-        .write_word = &DMA::handle_write_word,
-        .write_dword = [](VirtualAddress, DWord) {},
-        .write_qword = [](VirtualAddress, QWord) {},
-    };
+    if (!valid)
+    {
+        printf("DMA: invalid RAM transfer %08X <- %08X (%u bytes)\n", info.dst + offset, info.src + offset, bytes);
+    }
 }
 
-void DMA::initialize()
-{}
+// The device address of the USI channel is a byte offset in the disk
+static void dma_usi_transfer(const DMA::DMAChannelInfo& info, Word offset, Word bytes)
+{
+    bool valid = false;
+    switch (DMA::get_direction(info.ctr))
+    {
+    case DMA::DMA_RAM_TO_DEVICE:
+        valid = USI::write_disk(u64(info.dst) + offset, info.src + offset, bytes);
+        break;
+    case DMA::DMA_DEVICE_TO_RAM:
+        valid = USI::read_disk(u64(info.src) + offset, info.dst + offset, bytes);
+        break;
+    default:
+        break;
+    }
 
-void DMA::shutdown()
-{}
+    if (!valid)
+    {
+        printf("DMA: invalid USI transfer %08X <- %08X (%u bytes)\n", info.dst + offset, info.src + offset, bytes);
+    }
+}
+
+static void dma_transfer_chunk(DMA::DMAChannel ch, const DMA::DMAChannelInfo& info, Word offset, Word count)
+{
+    switch (ch)
+    {
+    case DMA::DMA_CHANNEL_RAM:
+        dma_ram_transfer(info, offset, count * DMA::get_step_size(DMA::get_step(info.ctr)));
+        break;
+    case DMA::DMA_CHANNEL_USI:
+        dma_usi_transfer(info, offset, count);
+        break;
+    case DMA::DMA_CHANNEL_SPU:
+        if (!SPU::dma_send(info.dst + offset, info.src + offset, count * DMA::get_step_size(DMA::get_step(info.ctr)), info.ctr))
+        {
+            printf("DMA: invalid SPU transfer %08X <- %08X\n", info.dst + offset, info.src + offset);
+        }
+        break;
+    case DMA::DMA_CHANNEL_GU:
+        GUDevice::dma_send(info.dst + offset, info.src + offset, count, info.ctr);
+        break;
+    default:
+        // No device behind the channel, it completes without moving data
+        break;
+    }
+}
 
-void DMA::dispatch()
+// A copy inside one address space whose destination overlaps the source from
+// above runs its chunks last to first, so no chunk reads bytes already written
+static bool dma_copy_backward(DMA::DMAChannel ch, const DMA::DMAChannelInfo& info, u64 bytes)
 {
-    std::lock_guard<std::mutex> dma_mutex_guard{ dma_mutex };
-    for (DMAChannel ch = DMA_CHANNEL_RAM; ch < DMA_CHANNELS_MAX; ((int&)ch)++)
+    bool same_space = false;
+    switch (ch)
     {
-        DMAChannelInfo& channel = get_registers().channels[ch];
-        if (channel.ctr & DMA_BUSY)
+    case DMA::DMA_CHANNEL_RAM:
+        same_space = !(info.ctr & DMA::DMA_FILL_MODE_U32);
+        break;
+    case DMA::DMA_CHANNEL_SPU:
+    case DMA::DMA_CHANNEL_GU:
+        same_space = DMA::get_direction(info.ctr) == DMA::DMA_DEVICE_TO_DEVICE;
+        break;
+    default:
+        break;
+    }
+
+    return same_space && info.dst > info.src && info.dst - info.src < bytes;
+}
+
+static void dma_restart_channel(DMA::DMAChannel ch)
+{
+    DMA::ChannelState& state = DMA::channel_states[ch];
+    state.generation++;
+    state.loaded = false;
+    state.armed = true;
+    state.descriptor_count = 0;
+}
+
+void DMA::drain_kicks()
+{
+    if (kicks_overflow.exchange(false, std::memory_order_acquire))
+    {
+        kicks.clear();
+        for (Word ch = 0; ch < DMA_CHANNELS_MAX; ch++)
         {
-            switch (ch)
+            dma_restart_channel(DMAChannel(ch));
+        }
+        return;
+    }
+
+    DMAKick kick;
+    while (kicks.pop(kick))
+    {
+        dma_restart_channel(DMAChannel(kick.channel));
+
+        // A completion may have cleared BUSY after this kick was stored,
+        // it is set again if the guest didn't write the register since then
+        if (kick.ctr & DMA_START)
+        {
+            Word expected = kick.ctr & ~Word(DMA_BUSY);
+            dma_reg(get_registers().channels[kick.channel].ctr).compare_exchange_strong(expected, kick.ctr);
+        }
+    }
+}
+
+bool DMA::load_transfer(DMAChannel ch)
+{
+    ChannelState& state = channel_states[ch];
+    DMAChannelInfo& regs = get_registers().channels[ch];
+    const Word ctr = dma_reg(regs.ctr).load(std::memory_order_acquire);
+
+    state.progress = 0;
+    state.transfer.ctr = ctr;
+    if (!(ctr & DMA_LINKED_LIST))
+    {
+        state.transfer.dst = dma_reg(regs.dst).load(std::memory_order_relaxed);
+        state.transfer.src = dma_reg(regs.src).load(std::memory_order_relaxed);
+        state.transfer.cnt = dma_reg(regs.cnt).load(std::memory_order_relaxed);
+        state.loaded = true;
+        return true;
+    }
+
+    const Word address = state.descriptor_count == 0 ? dma_reg(regs.src).load(std::memory_order_relaxed) : state.next_descriptor;
+    if (state.descriptor_count == MaxDescriptors)
+    {
+        printf("DMA: channel %d list exceeds %u descriptors\n", ch, MaxDescriptors);
+        return false;
+    }
+
+    DMADescriptor descriptor;
+    if ((address & 0x3) || !Bus::read_block(address, &descriptor, sizeof(DMADescriptor)))
+    {
+        printf("DMA: channel %d invalid descriptor at %08X\n", ch, address);
+        return false;
+    }
+
+    state.transfer.dst = descriptor.dst;
+    state.transfer.src = descriptor.src;
+    state.transfer.cnt = descriptor.cnt;
+    state.next_descriptor = descriptor.next;
+    state.descriptor_count++;
+    state.loaded = true;
+    cycle_counter += SetupCycles;
+    return true;
+}
+
+void DMA::worker()
+{
+    f64 start_time = Time::get_time();
+    u64 start_cycles = cycle_counter;
+
+    while (!dma_exit.load(std::memory_order_acquire))
+    {
+        const Word seen_kicks = kick_counter.load(std::memory_order_acquire);
+        drain_kicks();
+
+        const i32 selected = dma_select_channel();
+        if (selected < 0)
+        {
+            kick_counter.wait(seen_kicks, std::memory_order_acquire);
+
+            start_time = Time::get_time();
+            start_cycles = cycle_counter;
+            continue;
+        }
+
+        const DMAChannel ch = DMAChannel(selected);
+        ChannelState& state = channel_states[ch];
+        last_channel = ch;
+
+        if (!state.loaded && !load_transfer(ch))
+        {
+            complete_channel(ch);
+            continue;
+        }
+
+        const DMAChannelInfo info = state.transfer;
+        const Word total = info.ctr & DMA_LINKED_LIST ? info.cnt & ~DMA_DESCRIPTOR_IRQ : info.cnt;
+        // The USI channel ignores the step, it always counts bytes
+        const Word step_size = ch == DMA_CHANNEL_USI ? 1 : std::max(get_step_size(get_step(info.ctr)), 1U);
+        const Word done = state.progress;
+        const Word remaining = total - std::min(done, total);
+        const Word count = std::min(remaining, ChunkSize / step_size);
+        const Word first = dma_copy_backward(ch, info, u64(total) * step_size) ? remaining - count : done;
+
+        if (count)
+        {
+            dma_transfer_chunk(ch, info, first * step_size, count);
+        }
+
+        // The channel was restarted or stopped during the chunk
+        const Word generation = state.generation;
+        drain_kicks();
+        if (state.generation != generation)
+            continue;
+
+        state.progress = done + count;
+        cycle_counter += SetupCycles + (count * step_size) / BytesPerCycle;
+        if (state.progress >= total)
+        {
+            state.loaded = false;
+            if (!(info.ctr & DMA_LINKED_LIST))
+            {
+                complete_channel(ch);
+            }
+            else
             {
-            case DMA_CHANNEL_GU:
-                GUDevice::dma_send(channel.dst, channel.src, channel.cnt, channel.ctr);
-                break;
-            default:
-                break;
+                if (info.cnt & DMA_DESCRIPTOR_IRQ)
+                    signal_channel(ch);
+
+                if (state.next_descriptor == DMA_LIST_END)
+                    complete_channel(ch);
             }
         }
+
+        // Wait when the transfers are ahead of the guest clock
+        const f64 guest_time = f64(cycle_counter - start_cycles) / CPUCore::ClockSpeed;
+        const f64 host_time = Time::get_time() - start_time;
+        if (guest_time - host_time >= 0.001)
+        {
+            OS::sleep(i32((guest_time - host_time) * 1000.0));
+        }
     }
 }
 
-void DMA::handle_write_word(VirtualAddress local_address, Word value)
+void DMA::signal_channel(DMAChannel ch)
 {
-    std::lock_guard<std::mutex> dma_mutex_guard{ dma_mutex };
-    if (local_address >= DMA_CHANNELS_START && local_address < DMA_CHANNELS_END)
+    DMARegisters& regs = get_registers();
+    dma_reg(regs.irq_status).fetch_or(1U << ch, std::memory_order_release);
+    if (dma_reg(regs.irq_mask).load(std::memory_order_relaxed) & (1U << ch))
     {
-        dma_channel_write(DMAChannel((local_address & 0xF0) >> 4), (local_address & 0xF) >> 2, value);
-        return;
+        IRQ::raise(IRQ::IRQ_MASK_DMA);
     }
+}
+
+void DMA::complete_channel(DMAChannel ch)
+{
+    // A control write since the transfer started owns the register now
+    const Word ctr = channel_states[ch].transfer.ctr;
+    Word expected = ctr;
+    dma_reg(get_registers().channels[ch].ctr).compare_exchange_strong(expected, ctr & ~Word(DMA_BUSY), std::memory_order_acq_rel);
+    channel_states[ch].loaded = false;
+    channel_states[ch].armed = false;
 
-    switch (local_address)
+    if (ctr & DMA_IRQ)
     {
-    case DMA_IRQ_MASK:
-        dma_set_irq_mask(value);
-        break;
-    case DMA_IRQ_STATUS:
-        dma_set_irq_status(value);
-        break;
-    case DMA_WAIT_ON_MASK:
-        dma_wait_on(value);
-        break;
+        signal_channel(ch);
+    }
+}
+
+void DMA::write_channel(VirtualAddress local_address, Word value)
+{
+    const DMAChannel ch = DMAChannel((local_address & 0xF0) >> 4);
+    const u8 reg = (local_address & 0xF) >> 2;
+    dma_reg(get_registers().channels[ch].raw_regs[reg]).store(value, std::memory_order_release);
+
+    // Writing the control register restarts the channel
+    if (reg == 0)
+    {
+        if (!kicks.push(DMAKick{ ch, value }))
+            kicks_overflow.store(true, std::memory_order_release);
+
+        kick_counter.fetch_add(1, std::memory_order_release);
+        kick_counter.notify_one();
     }
 }
 
@@ -5,10 +5,12 @@
 /*        See the LICENSE in the project root.        */
 /******************************************************/
 #pragma once
+#include "Core/RingBuffer.h"
 #include "IO/IO.h"
 #include "Memory/Bus.h"
 
-#include <mutex>
+#include <atomic>
+#include <thread>
 
 struct CPUCore;
 
@@ -31,15 +33,21 @@ struct DMA
 
     // DMA Channel Control Register
     // [0] Start / Busy
-    // [1 - 2] Priority
+    // [1 - 2] Priority: the highest busy channel is served first, equal
+    //         priorities share the engine chunk by chunk
     // [3 - 4] Transfer direction:
     //         0(RAM -> DEVICE), 1(DEVICE -> RAM), 2(DEVICE -> DEVICE)
     // [5 - 7] Transfer Step: Ignored in DMA USI Channel
     //         0(4 bytes/1 Word), 1(2 bytes/1 Half), 2(1 byte), 3(8 bytes/1 DWord),
     //         4(16 bytes/1 QWord)
     //
+    // [29] Linked List: src is the address of the first DMADescriptor, every
+    //      descriptor is transferred with the step, direction and fill mode
+    //      of this register until the end marker
     // [30] Fill Mode: 0(Normal fill mode, same as a copy from dest -> src),
     //                 1(Fill dest memory range with the value in the src register)
+    //                 Only in the DMA RAM Channel, byte and half steps repeat the
+    //                 low bits of src
     // [31] IRQ Enable
 
     enum DMAChannel
@@ -57,7 +65,7 @@ struct DMA
         DMA_IRQ_MASK_RAM = 0x1,
         DMA_IRQ_MASK_USI = 0x2,
         DMA_IRQ_MASK_SPU = 0x4,
-        DMA_IRQ_MASK_GU = 0x4,
+        DMA_IRQ_MASK_GU = 0x8,
     };
 
     enum DMAPriority
@@ -65,6 +73,7 @@ struct DMA
         DMA_PRIORITY_LOW = 0x0,
         DMA_PRIORITY_NORMAL = 0x1,
         DMA_PRIORITY_HIGH = 0x2,
+        DMA_PRIORITY_URGENT = 0x3,
     };
 
     enum DMADirection
@@ -89,6 +98,7 @@ struct DMA
         DMA_START = 0x1,
         DMA_BUSY = 0x1,
 
+        DMA_LINKED_LIST = 0x2000'0000,
         DMA_FILL_MODE_U32 = 0x4000'0000,
         DMA_IRQ = 0x8000'0000,
     };
@@ -106,6 +116,23 @@ struct DMA
         Word raw_regs[4];
     };
 
+    // Linked list descriptor in RAM, word aligned
+    struct DMADescriptor
+    {
+        // DMA_LIST_END ends the list
+        Word next;
+        Word dst;
+        Word src;
+        // [0 - 30] Count
+        // [31] Raise the channel IRQ when this descriptor is done
+        Word cnt;
+    };
+
+    static constexpr Word DMA_LIST_END = 0xFFFF'FFFF;
+    static constexpr Word DMA_DESCRIPTOR_IRQ = 0x8000'0000;
+    // Bounds a kick, a list that loops forever stops here
+    static constexpr Word MaxDescriptors = 4096;
+
     struct DMARegisters
     {
         DMAChannelInfo channels[16];
@@ -115,7 +142,67 @@ struct DMA
         Word wait_on_mask;
     };
 
-    static inline std::mutex dma_mutex;
+    // Transfers run on the DMA thread in chunks of ChunkSize bytes, every
+    // chunk costs SetupCycles plus one guest cycle per BytesPerCycle bytes
+    // and the thread is paced to the guest clock.
+    static constexpr Word ChunkSize = KB(64);
+    static constexpr Word BytesPerCycle = 4;
+    static constexpr Word SetupCycles = 16;
+
+    // A control write stores the register and queues a kick for the DMA thread,
+    // the core never waits for the engine. Registers are accessed as atomics.
+    struct DMAKick
+    {
+        Word channel;
+        Word ctr;
+    };
+
+    static inline RingBuffer<DMAKick, 64> kicks;
+    // Set when the ring was full, the worker then reloads every channel
+    static inline std::atomic<bool> kicks_overflow = false;
+    static inline std::atomic<Word> kick_counter = 0;
+
+    static inline std::thread dma_thread;
+    static inline std::atomic<bool> dma_exit = false;
+
+    // Owned by the DMA thread
+    struct ChannelState
+    {
+        // Current transfer, a copy of the registers or the current descriptor
+        DMAChannelInfo transfer;
+        // Units already transferred
+        Word progress;
+        Word next_descriptor;
+        Word descriptor_count;
+        // Bumped on every control write, a chunk of an older kick is discarded
+        Word generation;
+        bool loaded;
+        // Set when its kick is drained, so a control word stored before the
+        // kick was queued can't start the channel twice
+        bool armed;
+    };
+
+    static inline ChannelState channel_states[DMA_CHANNELS_MAX];
+    static inline Word last_channel = 0;
+    static inline u64 cycle_counter = 0;
+
+    static constexpr DMAPriority get_priority(Word ctr) { return DMAPriority((ctr >> 1) & 0x3); }
+    static constexpr DMADirection get_direction(Word ctr) { return DMADirection((ctr >> 3) & 0x3); }
+    static constexpr DMAStep get_step(Word ctr) { return DMAStep((ctr >> 5) & 0x7); }
+
+    static constexpr Word get_step_size(DMAStep step)
+    {
+        switch (step)
+        {
+        case DMA_WORD: return sizeof(Word);
+        case DMA_HALF: return sizeof(u16);
+        case DMA_BYTE: return sizeof(u8);
+        case DMA_DWORD: return sizeof(DWord);
+        case DMA_QWORD: return sizeof(QWord);
+        }
+
+        return 0;
+    }
 
     static IO::IODevice get_io_device();
     static DMARegisters& get_registers()
@@ -126,8 +213,12 @@ struct DMA
     static void initialize();
     static void shutdown();
 
-    static void dispatch();
+    static void worker();
+    static void drain_kicks();
+    static bool load_transfer(DMAChannel ch);
+    static void signal_channel(DMAChannel ch);
+    static void complete_channel(DMAChannel ch);
 
-    static void handle_write_word(VirtualAddress local_address, Word value);
+    static void write_channel(VirtualAddress local_address, Word value);
 
 };
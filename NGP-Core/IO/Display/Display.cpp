@@ -6,75 +6,62 @@
 /******************************************************/
 #include "IO/Display/Display.h"
 
+#include "IO/RegisterMap.h"
 #include "Video/GUDevice.h"
 
 
-IO::IODevice Display::get_io_device()
+static void display_set_ctr(VirtualAddress, Word value)
 {
-	return IO::IODevice
-	{
-		.base_address = IO::DISPLAY_BASE,
+	Display::get_registers().ctr = value;
 
-		.initialize = &Display::initialize,
-		.shutdown = &Display::shutdown,
-		.dispatch = []() {},
-
-		.read_byte = [](VirtualAddress) -> u8 { return 0; },
-		.read_half = [](VirtualAddress) -> u16 { return 0; },
-		.read_word = [](VirtualAddress) -> Word { return 0; },
-		.read_dword = [](VirtualAddress) -> DWord { return 0; },
-		.read_qword = [](VirtualAddress) -> QWord { return QWord(); },
+	if (value & Display::PRESENT)
+	{
+		GUDevice::request_present();
+	}
+}
 
-		.write_byte = [](VirtualAddress, u8) {},
-		.write_half = [](VirtualAddress, u16) {},
-		.write_word = &Display::handle_write_word,
-		.write_dword = [](VirtualAddress, DWord) {},
-		.write_qword = [](VirtualAddress, QWord) {},
-	};
+static void display_set_buffer_addr(VirtualAddress, Word value)
+{
+	if (Display::get_registers().ctr & Display::ENABLE)
+	{
+		GUDevice::display_set_address(value);
+		Display::get_registers().buffer_addr = value;
+	}
 }
 
-void Display::initialize()
+static void display_set_format(VirtualAddress, Word value)
 {
-	get_registers().id = DISPLAY_1;
+	if (Display::get_registers().ctr & Display::ENABLE)
+	{
+		GUDevice::display_set_config(
+			value & 0x3FFF, (value >> 14) & 0x3FFF, 
+			(Display::DisplayFormat)(value >> 28)
+		);
+		Display::get_registers().format = value;
+	}
 }
 
-void Display::shutdown()
-{}
+static constexpr IO::RegisterInfo display_register_map[] =
+{
+	{ Display::DISPLAY_IRQ_MASK, 4, IO::REG_READ_WRITE, nullptr },
+	{ Display::DISPLAY_IRQ_STATUS, 4, IO::REG_READ_WRITE, nullptr },
+	{ Display::DISPLAY_CTR, 4, IO::REG_READ_WRITE, &display_set_ctr },
+	{ Display::DISPLAY_ID, 4, IO::REG_READ, nullptr },
+	{ Display::DISPLAY_BUFFER_ADDR, 4, IO::REG_READ_WRITE, &display_set_buffer_addr },
+	{ Display::DISPLAY_FORMAT, 4, IO::REG_READ_WRITE, &display_set_format },
+};
 
+static constexpr IO::RegisterTable display_registers = IO::make_register_table(display_register_map);
 
-void Display::handle_write_word(VirtualAddress local_address, Word value)
+IO::IODevice Display::get_io_device()
 {
-	switch (local_address)
-	{
-	case DISPLAY_CTR:
-	{
-		get_registers().ctr = value;
+	return IO::make_io_device<IO::DISPLAY_BASE, display_registers>(&Display::initialize, &Display::shutdown, []() {});
+}
 
-		if (value & PRESENT)
-		{
-			GUDevice::request_present();
-		}
-	}
-		break;
-	case DISPLAY_BUFFER_ADDR:
-		if (get_registers().ctr & ENABLE)
-		{
-			GUDevice::display_set_address(value);
-			get_registers().buffer_addr = value;
-		}
-		break;
-	case DISPLAY_FORMAT:
-		if (get_registers().ctr & ENABLE)
-		{
-			GUDevice::display_set_config(
-				value & 0x3FFF, (value >> 14) & 0x3FFF, 
-				(Display::DisplayFormat)(value >> 28)
-			);
-			get_registers().format = value;
-		}
-		break;
-	default:
-		break;
-	}
+void Display::initialize()
+{
+	get_registers().id = DISPLAY_1;
 }
 
+void Display::shutdown()
+{}
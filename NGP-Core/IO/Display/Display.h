@@ -76,6 +76,4 @@ struct Display
     static void initialize();
     static void shutdown();
 
-    static void handle_write_word(VirtualAddress local_address, Word value);
-
 };
\ No newline at end of file
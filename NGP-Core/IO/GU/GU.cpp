@@ -7,44 +7,33 @@
 #include "IO/GU/GU.h"
 
 #include "CPU/CPUCore.h"
+#include "IO/RegisterMap.h"
 #include "Memory/Bus.h"
 #include "Video/GUDevice.h"
 
+#include <atomic>
 
-static inline void gu_irq_mask(VirtualAddress value)
-{
-}
 
-static inline void gu_set_status(VirtualAddress value)
+static constexpr IO::RegisterInfo gu_register_map[] =
 {
-}
+    { GU::GU_IRQ_MASK, 4, IO::REG_READ_WRITE, nullptr },
+    { GU::GU_IRQ_STATUS, 4, IO::REG_READ_WRITE, nullptr },
+    { GU::GU_CTR, 4, IO::REG_READ_WRITE, nullptr },
+    { GU::GU_ID, 4, IO::REG_READ, nullptr },
+    { GU::GU_QUEUE_CTR, 4, IO::REG_READ_WRITE, &GU::write_queue_ctr },
+    { GU::GU_QUEUE_STATE, 4, IO::REG_READ, nullptr },
+    { GU::GU_QUEUE_ADDR, 4, IO::REG_READ_WRITE, nullptr },
+    { GU::GU_QUEUE_LEN, 4, IO::REG_READ_WRITE, nullptr },
+    { GU::GU_QUEUE_SEQ, 4, IO::REG_READ, nullptr },
+    { GU::GU_QUEUE_FENCE, 4, IO::REG_READ, nullptr },
+    { GU::GU_QUEUE_FLAGS, 4, IO::REG_READ_WRITE, nullptr },
+};
 
-static inline void gu_set_ctr(VirtualAddress value)
-{
-}
+static constexpr IO::RegisterTable gu_registers = IO::make_register_table(gu_register_map);
 
 IO::IODevice GU::get_io_device()
 {
-    return IO::IODevice
-    {
-        .base_address = IO::GU_BASE,
-
-        .initialize = &GU::initialize,
-        .shutdown = &GU::shutdown,
-        .dispatch = &GU::dispatch,
-
-        .read_byte = [](VirtualAddress) -> u8 { return 0; },
-        .read_half = [](VirtualAddress) -> u16 { return 0; },
-        .read_word = [](VirtualAddress) -> Word { return 0; },
-        .read_dword = [](VirtualAddress) -> DWord { return 0; },
-        .read_qword = [](VirtualAddress) -> QWord { return QWord(); },
-
-        .write_byte = [](VirtualAddress, u8) {},
-        .write_half = [](VirtualAddress, u16) {},
-        .write_word = &GU::handle_write_word,
-        .write_dword = [](VirtualAddress, DWord) {},
-        .write_qword = [](VirtualAddress, QWord) {},
-    };
+    return IO::make_io_device<IO::GU_BASE, gu_registers>(&GU::initialize, &GU::shutdown, &GU::dispatch);
 }
 
 void GU::initialize()
@@ -60,39 +49,17 @@ void GU::dispatch()
     GUDevice::queue_dispatch();
 }
 
-void GU::handle_write_word(VirtualAddress local_address, Word value)
+void GU::write_queue_ctr(VirtualAddress, Word value)
 {
-    switch (local_address)
+    GURegisters& regs = get_registers();
+    std::atomic_ref<Word>(regs.queue_ctr).store(value, std::memory_order_relaxed);
+
+    if (value & QUEUE_START)
     {
-    case GU_IRQ_MASK:
-        gu_irq_mask(value);
-        break;
-    case GU_IRQ_STATUS:
-        gu_set_status(value);
-        break;
-    case GU_CTR:
-        gu_set_ctr(value);
-        break;
-    case GU_ID:
-        // Ignored
-        break;
-    case GU_QUEUE_CTR:
-        if (value & QUEUE_START)
-        {
-            GUDevice::queue_execute(
-                get_registers().queue_addr,
-                get_registers().queue_len
-            );
-        }
-        break;
-    case GU_QUEUE_STATE:
-        break;
-    case GU_QUEUE_ADDR:
-        get_registers().queue_addr = value;
-        break;
-    case GU_QUEUE_LEN:
-        get_registers().queue_len = value;
-        break;
+        GUDevice::queue_execute(
+            std::atomic_ref<Word>(regs.queue_addr).load(std::memory_order_relaxed),
+            std::atomic_ref<Word>(regs.queue_len).load(std::memory_order_relaxed)
+        );
     }
 }
 
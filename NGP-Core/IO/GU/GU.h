@@ -28,8 +28,10 @@ struct GU
         // Command Queue
         // [31] -> Start execution
         GU_QUEUE_CTR =      0x0010,
-        // [0 - 31] Queue State.
-        // Command Queue State
+        // [0 - 7] Queue State.
+        // [8 - 31] Low bits of the sequence the state belongs to.
+        // Command Queue State, QUEUE_BUSY while kicked lists are pending,
+        // then the result of the last one
         GU_QUEUE_STATE =    0x0014,
         // Command List Address
         // [0 - 31] Command List Base Address.
@@ -37,6 +39,15 @@ struct GU
         // Command List Address
         // [0 - 31] Command List Buffer Size, in words.
         GU_QUEUE_LEN =  0x001C,
+        // Command List Sequence
+        // [0 - 31] Sequence given to the last kicked list, the first one is 1.
+        GU_QUEUE_SEQ =  0x0020,
+        // Command List Fence
+        // [0 - 31] Sequence of the last completed list, lists complete in order.
+        GU_QUEUE_FENCE = 0x0024,
+        // Command List Flags
+        // [0 - 23] Tested by CMD_JUMP_IF, sampled when a list starts.
+        GU_QUEUE_FLAGS = 0x0028,
     };
 
     enum IRQMask
@@ -65,8 +76,33 @@ struct GU
         QUEUE_BUSY = 0x1,
         QUEUE_ERROR_BAD_ADDRESS = 0x2,
         QUEUE_ERROR_BAD_LEN = 0x3,
+        QUEUE_ERROR_BAD_COMMAND = 0x4,
+        QUEUE_ERROR_BAD_ARGUMENT = 0x5,
+        // Call stack overflow, a list that never ends or loops into too many words
+        QUEUE_ERROR_BAD_BRANCH = 0x6,
+        // The kick was dropped, too many lists are pending. Wait for
+        // GU_QUEUE_FENCE and kick again
+        QUEUE_ERROR_FULL = 0x7,
     };
 
+    static constexpr Word QueueStateMask = 0xFF;
+
+    // GU_QUEUE_STATE value, the sequence lets a completion tell if a newer kick replaced its state
+    static constexpr Word make_queue_state(Word sequence, QueueState queue_state)
+    {
+        return (sequence << 8) | queue_state;
+    }
+
+    // Sequences wrap, a is newer than b when it is less than half the range ahead
+    static constexpr bool sequence_after(Word a, Word b)
+    {
+        return i32(a - b) > 0;
+    }
+
+    // Red is in the low bits of every format
+    // RGBA4:    [0 - 3] R, [4 - 7] G, [8 - 11] B, [12 - 15] A
+    // RGB565:   [0 - 4] R, [5 - 10] G, [11 - 15] B
+    // RGBA5551: [0 - 4] R, [5 - 9] G, [10 - 14] B, [15] A
     enum TextureFormat
     {
         TEXTURE_FORMAT_RGBA8 = 0x0,
@@ -74,6 +110,70 @@ struct GU
         TEXTURE_FORMAT_RGBA4 = 0x2,
         TEXTURE_FORMAT_RGB565 = 0x3,
         TEXTURE_FORMAT_RGBA5551 = 0x4,
+
+        TEXTURE_FORMAT_COUNT,
+    };
+
+    enum TextureFilter
+    {
+        TEXTURE_FILTER_NEAREST = 0x0,
+        TEXTURE_FILTER_BILINEAR = 0x1,
+    };
+
+    // result = src * src_factor + dst * dst_factor
+    enum BlendFactor
+    {
+        BLEND_ZERO = 0x0,
+        BLEND_ONE = 0x1,
+        BLEND_SRC_ALPHA = 0x2,
+        BLEND_ONE_MINUS_SRC_ALPHA = 0x3,
+        BLEND_DST_ALPHA = 0x4,
+        BLEND_ONE_MINUS_DST_ALPHA = 0x5,
+
+        BLEND_FACTOR_COUNT,
+    };
+
+    // Compares the source alpha against the reference
+    enum AlphaTest
+    {
+        ALPHA_TEST_ALWAYS = 0x0,
+        ALPHA_TEST_NEVER = 0x1,
+        ALPHA_TEST_LESS = 0x2,
+        ALPHA_TEST_LEQUAL = 0x3,
+        ALPHA_TEST_EQUAL = 0x4,
+        ALPHA_TEST_GEQUAL = 0x5,
+        ALPHA_TEST_GREATER = 0x6,
+
+        ALPHA_TEST_COUNT,
+    };
+
+    // Words of a vertex: 0xYYYYXXXX position, then the attribute
+    enum VertexFormat
+    {
+        // 0xAABBGGRR | Gouraud shaded, the alpha of the first vertex is used.
+        VERTEX_FORMAT_COLOR = 0x0,
+        // 0xVVVVUUUU | U - V texel coordinates, 12.4 fixed point.
+        VERTEX_FORMAT_UV = 0x1,
+
+        VERTEX_FORMAT_COUNT,
+    };
+
+    enum Topology
+    {
+        TOPOLOGY_TRIANGLE_LIST = 0x0,
+        // 0xFFFF in the index buffer starts a new strip
+        TOPOLOGY_TRIANGLE_STRIP = 0x1,
+
+        TOPOLOGY_COUNT,
+    };
+
+    enum WriteMask
+    {
+        WRITE_MASK_R = 0x1,
+        WRITE_MASK_G = 0x2,
+        WRITE_MASK_B = 0x4,
+        WRITE_MASK_A = 0x8,
+        WRITE_MASK_RGBA = 0xF,
     };
 
     // GU Command Layout
@@ -93,6 +193,45 @@ struct GU
         //              T is for the texture unit.
         CMD_TEXTURE_SET = 0x2,
 
+        // 0x03BBGGRR | RGB clear color in command arguments, 8 bits each component.
+        //              Fills the whole draw buffer.
+        CMD_CLEAR = 0x3,
+
+        // 0x04000NMT | T is the texture unit, M the magnification filter,
+        //              N the minification filter.
+        CMD_TEXTURE_FILTER = 0x4,
+
+        // 0x05RRMTDS | S the source factor, D the destination factor, T the alpha test,
+        //              M the write mask, R the alpha test reference.
+        // 0x000000AA | A alpha of the untextured primitives.
+        CMD_BLEND_STATE = 0x5,
+
+        // 0x06AAAAAA | Vertex buffer address in VRAM, aligned in 256 bytes.
+        // 0xFCCCCCCC | C the vertex count, F the GU::VertexFormat.
+        CMD_VERTEX_BUFFER = 0x6,
+
+        // 0x07AAAAAA | Index buffer address in VRAM, aligned in 256 bytes.
+        // 0x00CCCCCC | C the count of 16 bit indices.
+        CMD_INDEX_BUFFER = 0x7,
+
+        // 0x10000000 | The rest of the current list is replaced by the target.
+        // 0xAAAAAAAA | A the address of the target list in RAM, aligned in 4 bytes.
+        // 0xLLLLLLLL | L the max length of the target list, in words.
+        CMD_JUMP = 0x10,
+
+        // 0x11000000 | Runs the target list, CMD_RETURN or its end continues after the call.
+        // 0xAAAAAAAA | A the address of the target list in RAM, aligned in 4 bytes.
+        // 0xLLLLLLLL | L the max length of the target list, in words.
+        CMD_CALL = 0x11,
+
+        // 0x12000000 | Back to the command after the last CMD_CALL, ends the top list.
+        CMD_RETURN = 0x12,
+
+        // 0x13MMMMMM | CMD_JUMP when GU_QUEUE_FLAGS & M is not 0.
+        // 0xAAAAAAAA | A the address of the target list in RAM, aligned in 4 bytes.
+        // 0xLLLLLLLL | L the max length of the target list, in words.
+        CMD_JUMP_IF = 0x13,
+
         // 0x20BBGGRR | RGB line color in command arguments, 8 bits each component.
         // 0xYYYYXXXX | X - Y top left coordinates of the rectangle.
         // 0xHHHHWWWW | W - H size of the rectangle.
@@ -114,6 +253,32 @@ struct GU
         // 0xYYYYXXXX | X - Y top left coordinates of the second vertex of the triangle.
         // 0xYYYYXXXX | X - Y top left coordinates of the third vertex of the triangle.
         CMD_FILL_TRIANGLE = 0x23,
+
+        // 0x2400000T | T is the texture unit.
+        // 0xYYYYXXXX | X - Y coordinates of the first vertex.
+        // 0xVVVVUUUU | U - V texel coordinates of the first vertex, 12.4 fixed point.
+        // 0xYYYYXXXX | X - Y coordinates of the second vertex.
+        // 0xVVVVUUUU | U - V texel coordinates of the second vertex, 12.4 fixed point.
+        // 0xYYYYXXXX | X - Y coordinates of the third vertex.
+        // 0xVVVVUUUU | U - V texel coordinates of the third vertex, 12.4 fixed point.
+        CMD_TEXTURED_TRIANGLE = 0x24,
+
+        // 0x2500000T | T is the texture unit.
+        // 0xYYYYXXXX | X - Y top left coordinates of the sprite.
+        // 0xHHHHWWWW | W - H size of the sprite.
+        // 0xVVVVUUUU | U - V top left texel of the source.
+        // 0xHHHHWWWW | W - H size of the source in texels, scaled to the sprite size.
+        CMD_SPRITE = 0x25,
+
+        // 0x260000UT | T the GU::Topology, U the texture unit of VERTEX_FORMAT_UV.
+        // 0xFFFFFFFF | F the first vertex of the vertex buffer.
+        // 0xCCCCCCCC | C the vertex count.
+        CMD_DRAW = 0x26,
+
+        // 0x270000UT | T the GU::Topology, U the texture unit of VERTEX_FORMAT_UV.
+        // 0xFFFFFFFF | F the first index of the index buffer.
+        // 0xCCCCCCCC | C the index count.
+        CMD_DRAW_INDEXED = 0x27,
     };
 
     struct GURegisters
@@ -129,6 +294,11 @@ struct GU
         Word queue_state;
         Word queue_addr;
         Word queue_len;
+
+        // 0x020
+        Word queue_seq;
+        Word queue_fence;
+        Word queue_flags;
     };
 
     static IO::IODevice get_io_device();
@@ -142,5 +312,5 @@ struct GU
 
     static void dispatch();
 
-    static void handle_write_word(VirtualAddress local_address, Word value);
+    static void write_queue_ctr(VirtualAddress local_address, Word value);
 };
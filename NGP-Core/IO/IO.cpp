@@ -11,6 +11,7 @@
 #include "IO/GU/GU.h"
 #include "IO/IRQ/IRQ.h"
 #include "IO/Pad/Pad.h"
+#include "IO/SPU/SPU.h"
 #include "IO/USI/USI.h"
 
 #include "Memory/Bus.h"
@@ -71,6 +72,9 @@ void initialize()
         case DISPLAY_SEGMENT:
             io_devices.emplace_back(Display::get_io_device());
             break;
+        case SPU_SEGMENT:
+            io_devices.emplace_back(SPU::get_io_device());
+            break;
         case GU_SEGMENT:
             io_devices.emplace_back(GU::get_io_device());
             break;
@@ -109,7 +113,7 @@ u8 read_io_byte(VirtualAddress address)
     const u32 io_segment = (address & 0x0FFF'F000) >> 12;
     if (io_segment >= LAST_SEGMENT)
     {
-        Bus::invalid_write(address);
+        Bus::invalid_read(address);
         return 0;
     }
 
@@ -122,7 +126,7 @@ u16 read_io_half(VirtualAddress address)
     const u32 io_segment = (address & 0x0FFF'F000) >> 12;
     if (io_segment >= LAST_SEGMENT)
     {
-        Bus::invalid_write(address);
+        Bus::invalid_read(address);
         return 0;
     }
 
@@ -135,7 +139,7 @@ Word read_io_word(VirtualAddress address)
     const u32 io_segment = (address & 0x0FFF'F000) >> 12;
     if (io_segment >= LAST_SEGMENT)
     {
-        Bus::invalid_write(address);
+        Bus::invalid_read(address);
         return 0;
     }
 
@@ -148,7 +152,7 @@ DWord read_io_dword(VirtualAddress address)
     const u32 io_segment = (address & 0x0FFF'F000) >> 12;
     if (io_segment >= LAST_SEGMENT)
     {
-        Bus::invalid_write(address);
+        Bus::invalid_read(address);
         return 0;
     }
 
@@ -161,7 +165,7 @@ QWord read_io_qword(VirtualAddress address)
     const u32 io_segment = (address & 0x0FFF'F000) >> 12;
     if (io_segment >= LAST_SEGMENT)
     {
-        Bus::invalid_write(address);
+        Bus::invalid_read(address);
         return QWord();
     }
 
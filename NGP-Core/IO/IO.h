@@ -21,6 +21,7 @@ static constexpr VirtualAddress DMA_BASE =      IO_BASE | 0x0000'1000;
 static constexpr VirtualAddress PAD_BASE =      IO_BASE | 0x0000'2000;
 static constexpr VirtualAddress USI_BASE =      IO_BASE | 0x0000'3000;
 static constexpr VirtualAddress DISPLAY_BASE =  IO_BASE | 0x0000'4000;
+static constexpr VirtualAddress SPU_BASE =      IO_BASE | 0x0000'5000;
 
 static constexpr VirtualAddress GU_BASE =       IO_BASE | 0x0001'0000;
 
@@ -35,6 +36,7 @@ enum IOSegments
     PAD_SEGMENT = 0x2,
     USI_SEGMENT = 0x3,
     DISPLAY_SEGMENT = 0x4,
+    SPU_SEGMENT = 0x5,
 
     GU_SEGMENT = 0x10,
 
@@ -6,31 +6,23 @@
 /******************************************************/
 #include "IO/IRQ/IRQ.h"
 
+#include "IO/RegisterMap.h"
 #include "Memory/Bus.h"
 
+#include <atomic>
+
+
+static constexpr IO::RegisterInfo irq_register_map[] =
+{
+	{ IRQ::IRQ_MASK, 4, IO::REG_READ_WRITE, nullptr },
+	{ IRQ::IRQ_STATUS, 4, IO::REG_READ_WRITE, nullptr },
+};
+
+static constexpr IO::RegisterTable irq_registers = IO::make_register_table(irq_register_map);
 
 IO::IODevice IRQ::get_io_device()
 {
-	return IO::IODevice
-	{
-		.base_address = IO::IRQ_BASE,
-
-		.initialize = &IRQ::initialize,
-		.shutdown = &IRQ::shutdown,
-		.dispatch = []() {},
-
-		.read_byte = [](VirtualAddress) -> u8 { return 0; },
-		.read_half = [](VirtualAddress) -> u16 { return 0; },
-		.read_word = [](VirtualAddress) -> Word { return 0; },
-		.read_dword = [](VirtualAddress) -> DWord { return 0; },
-		.read_qword = [](VirtualAddress) -> QWord { return QWord(); },
-
-		.write_byte = [](VirtualAddress, u8) {},
-		.write_half = [](VirtualAddress, u16) {},
-		.write_word = &IRQ::handle_write_word,
-		.write_dword = [](VirtualAddress, DWord) {},
-		.write_qword = [](VirtualAddress, QWord) {},
-	};
+	return IO::make_io_device<IO::IRQ_BASE, irq_registers>(&IRQ::initialize, &IRQ::shutdown, []() {});
 }
 
 void IRQ::initialize()
@@ -39,16 +31,7 @@ void IRQ::initialize()
 void IRQ::shutdown()
 {}
 
-void IRQ::handle_write_word(VirtualAddress local_address, Word value)
+void IRQ::raise(Word mask)
 {
-	switch (local_address)
-	{
-	case IRQ_MASK:
-		get_registers().irq_mask = value;
-		break;
-	case IRQ_STATUS:
-		get_registers().irq_status = value;
-		break;
-	}
+	std::atomic_ref<Word>(get_registers().irq_status).fetch_or(mask, std::memory_order_release);
 }
-
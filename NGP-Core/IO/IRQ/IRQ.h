@@ -52,6 +52,7 @@ struct IRQ
     static void initialize();
     static void shutdown();
 
-    static void handle_write_word(VirtualAddress local_address, Word value);
+    // Sets the status bits of a device, safe to call from any device thread
+    static void raise(Word mask);
 
 };
@@ -6,31 +6,28 @@
 /******************************************************/
 #include "IO/Pad/Pad.h"
 
+#include "IO/IRQ/IRQ.h"
+#include "IO/RegisterMap.h"
 #include "Memory/Bus.h"
+#include "Platform/Time.h"
 
+#include <algorithm>
+#include <cstring>
+
+
+static constexpr IO::RegisterInfo pad_register_map[] =
+{
+    { Pad::PAD_MAIN_BUTTONS, 4, IO::REG_READ, nullptr },
+    { Pad::PAD_MAIN_STICKS, 4, IO::REG_READ, nullptr },
+    { Pad::PAD_MAIN_STATUS, 4, IO::REG_READ_WRITE, nullptr },
+    { Pad::PAD_MAIN_CTR, 4, IO::REG_READ_WRITE, nullptr },
+};
+
+static constexpr IO::RegisterTable pad_registers = IO::make_register_table(pad_register_map);
 
 IO::IODevice Pad::get_io_device()
 {
-    return IO::IODevice
-    {
-        .base_address = IO::PAD_BASE,
-
-        .initialize = &initialize,
-        .shutdown = &shutdown,
-        .dispatch = []() {},
-
-        .read_byte = [](VirtualAddress) -> u8 { return 0; },
-        .read_half = [](VirtualAddress) -> u16 { return 0; },
-        .read_word = [](VirtualAddress) -> Word { return 0; },
-        .read_dword = [](VirtualAddress) -> DWord { return 0; },
-        .read_qword = [](VirtualAddress) -> QWord { return QWord(); },
-
-        .write_byte = [](VirtualAddress, u8) {},
-        .write_half = [](VirtualAddress, u16) {},
-        .write_word = &handle_write_word,
-        .write_dword = [](VirtualAddress, DWord) {},
-        .write_qword = [](VirtualAddress, QWord) {},
-    };
+    return IO::make_io_device<IO::PAD_BASE, pad_registers>(&Pad::initialize, &Pad::shutdown, &Pad::latch);
 }
 
 void Pad::initialize()
@@ -45,46 +42,122 @@ void Pad::initialize()
         pads[i].ra_y = 0;
         pads[i].status = 0;
     }
+
+    events.clear();
+    events_dropped = 0;
+    pending_present_timestamp = -1.0;
+    std::memset(latency_histogram, 0, sizeof(latency_histogram));
+    latency_samples = 0;
+    latency_total = 0.0;
 }
 
 void Pad::shutdown()
-{}
+{
+    if (print_latency)
+    {
+        print_latency_histogram();
+    }
+}
 
 void Pad::update(u32 port, PadButton button, bool down)
 {
-    PadInfo& pad = pads[port];
-    if (down)
+    if (port >= MaxPadPort)
+        return;
+
+    if (!events.push(PadEvent{ port, button, down, Time::get_time() }))
+    {
+        events_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Pad::latch()
+{
+    MainPad& main_pad = get_main_pad();
+    const Word old_buttons = std::atomic_ref<Word>(main_pad.buttons).load(std::memory_order_relaxed);
+
+    PadEvent event;
+    while (events.pop(event))
     {
-        if (button < PAD_LEFT_AXIS_LEFT)
+        PadInfo& pad = pads[event.port];
+        if (event.button < PAD_LEFT_AXIS_LEFT)
         {
             // Masking the button bit
-            if(port == 0) 
-            {
-                get_main_pad().buttons |= (1 << button);
-            }
-            pad.buttons |= (1 << button);
+            if (event.down)
+                pad.buttons |= (1 << event.button);
+            else
+                pad.buttons &= ~(1 << event.button);
         }
         else
         {
             // set axis
         }
-    }
-    else
-    {
-        if (button < PAD_LEFT_AXIS_LEFT)
+
+        if (pending_present_timestamp < 0.0)
         {
-            // Unmasking the button bit
-            if (port == 0)
-            {
-                get_main_pad().buttons &= ~(1 << button);
-            }
-            pad.buttons &= ~(1 << button);
+            pending_present_timestamp = event.timestamp;
         }
     }
-}
 
+    const Word buttons = pads[0].buttons;
+    if (buttons == old_buttons)
+        return;
 
-void Pad::handle_write_word(VirtualAddress local_address, Word value)
+    std::atomic_ref<Word>(main_pad.buttons).store(buttons, std::memory_order_relaxed);
+    std::atomic_ref<Word>(main_pad.status).fetch_or(PAD_STATUS_CHANGED, std::memory_order_release);
+    if (std::atomic_ref<Word>(main_pad.ctr).load(std::memory_order_relaxed) & PAD_CTR_IRQ_ON_CHANGE)
+    {
+        IRQ::raise(IRQ::IRQ_MASK_PAD);
+    }
+}
+
+void Pad::frame_presented()
 {
+    if (pending_present_timestamp < 0.0)
+        return;
+
+    const f64 latency = Time::get_time() - pending_present_timestamp;
+    pending_present_timestamp = -1.0;
+
+    const u32 bucket = std::min(u32(latency * 1000.0), LatencyBuckets - 1);
+    latency_histogram[bucket]++;
+    latency_samples++;
+    latency_total += latency;
 }
 
+void Pad::print_latency_histogram()
+{
+    printf("Input to present latency, %llu samples", (unsigned long long)latency_samples);
+    if (latency_samples == 0)
+    {
+        printf("\n");
+        return;
+    }
+
+    printf(", mean %.2fms", latency_total * 1000.0 / f64(latency_samples));
+    const u64 dropped = events_dropped.load(std::memory_order_relaxed);
+    if (dropped)
+    {
+        printf(", %llu events dropped", (unsigned long long)dropped);
+    }
+    printf("\n");
+
+    u64 peak = 0;
+    for (u32 i = 0; i < LatencyBuckets; i++)
+    {
+        peak = std::max(peak, latency_histogram[i]);
+    }
+
+    for (u32 i = 0; i < LatencyBuckets; i++)
+    {
+        if (latency_histogram[i] == 0)
+            continue;
+
+        const u32 bar = u32(latency_histogram[i] * 50 / peak);
+        printf("%s%2ums %8llu ", i == LatencyBuckets - 1 ? ">=" : "  ", i, (unsigned long long)latency_histogram[i]);
+        for (u32 j = 0; j < bar; j++)
+        {
+            printf("#");
+        }
+        printf("\n");
+    }
+}
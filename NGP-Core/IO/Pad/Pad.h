@@ -7,6 +7,7 @@
 #pragma once
 #include "IO/IO.h"
 #include "Memory/Bus.h"
+#include "Core/RingBuffer.h"
 
 struct CPUCore;
 
@@ -14,12 +15,28 @@ struct Pad
 {
 
     static constexpr u32 MaxPadPort = 4;
+    // Input-to-present latency buckets of 1ms, the last one collects the rest
+    static constexpr u32 LatencyBuckets = 64;
 
     enum Register
     {
         PAD_MAIN_BUTTONS = 0x000,
         PAD_MAIN_STICKS = 0x004,
+        // [0] Changed
         PAD_MAIN_STATUS = 0x008,
+        // Pad Control
+        // [0] IRQ on change
+        PAD_MAIN_CTR = 0x00C,
+    };
+
+    enum PadStatusBit
+    {
+        PAD_STATUS_CHANGED = 0x1,
+    };
+
+    enum PadControlBit
+    {
+        PAD_CTR_IRQ_ON_CHANGE = 0x1,
     };
 
     enum PadButton
@@ -67,6 +84,7 @@ struct Pad
         } stick;
 
         Word status;
+        Word ctr;
     };
 
     struct PadInfo
@@ -81,8 +99,28 @@ struct Pad
         u32 port;
     };
 
+    struct PadEvent
+    {
+        u32 port;
+        PadButton button;
+        bool down;
+        // Host time of the event, in seconds
+        f64 timestamp;
+    };
+
     static inline PadInfo pads[Pad::MaxPadPort];
 
+    // Written by the window thread, latched once per frame by dispatch
+    static inline RingBuffer<PadEvent, 256> events;
+    static inline std::atomic<u64> events_dropped = 0;
+
+    // Oldest latched event not presented yet, negative when none
+    static inline f64 pending_present_timestamp = -1.0;
+    static inline u64 latency_histogram[LatencyBuckets];
+    static inline u64 latency_samples = 0;
+    static inline f64 latency_total = 0.0;
+    static inline bool print_latency = false;
+
     static IO::IODevice get_io_device();
     static MainPad& get_main_pad()
     {
@@ -93,6 +131,10 @@ struct Pad
     static void shutdown();
 
     static void update(u32 port, PadButton button, bool down);
-    static void handle_write_word(VirtualAddress local_address, Word value);
+    // Applies the queued events to the pads and the MMIO registers
+    static void latch();
+    // Called after a frame reaches the screen
+    static void frame_presented();
+    static void print_latency_histogram();
 
 };
@@ -0,0 +1,189 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#pragma once
+#include "IO/IO.h"
+#include "Memory/Bus.h"
+
+#include <atomic>
+
+namespace IO
+{
+
+enum RegisterAccess : u8
+{
+    REG_NONE = 0x0,
+    REG_READ = 0x1,
+    REG_WRITE = 0x2,
+    REG_READ_WRITE = REG_READ | REG_WRITE,
+};
+
+// Side effect of a register write, the handler does the store itself
+using RegisterWrite = void(*)(VirtualAddress local_address, Word value);
+
+struct RegisterInfo
+{
+    VirtualAddress offset;
+    // In bytes, a multiple of a word. An array of registers is one entry
+    Word size;
+    RegisterAccess access;
+    // Null for plain storage registers
+    RegisterWrite write;
+};
+
+static constexpr Word SegmentWords = SegmentSize / sizeof(Word);
+
+// Flat per word view of a register map, built at compile time
+struct RegisterTable
+{
+    RegisterWrite write[SegmentWords];
+    RegisterAccess access[SegmentWords];
+};
+
+template<usize N>
+consteval RegisterTable make_register_table(const RegisterInfo(&registers)[N])
+{
+    RegisterTable table = {};
+    for (const RegisterInfo& reg : registers)
+    {
+        for (Word slot = reg.offset / sizeof(Word); slot < (reg.offset + reg.size) / sizeof(Word); slot++)
+        {
+            table.write[slot] = reg.write;
+            table.access[slot] = reg.access;
+        }
+    }
+
+    return table;
+}
+
+// Every access width of a device, generated from its table. Reads come from
+// the register storage, narrow writes are merged into the word before the
+// handler sees them and wide writes are split in words.
+template<VirtualAddress Base, const RegisterTable& Table>
+struct RegisterDispatch
+{
+    static std::atomic_ref<Word> storage(VirtualAddress local_address)
+    {
+        return std::atomic_ref<Word>(*(Word*)(Bus::MAPPED_BUS_ADDRESS_START + Base + (local_address & SegmentMask & ~3U)));
+    }
+
+    static Word read_word(VirtualAddress local_address)
+    {
+        if (!(Table.access[(local_address & SegmentMask) >> 2] & REG_READ))
+            return 0;
+
+        return storage(local_address).load(std::memory_order_acquire);
+    }
+
+    static void write_word(VirtualAddress local_address, Word value)
+    {
+        const Word slot = (local_address & SegmentMask) >> 2;
+        if (!(Table.access[slot] & REG_WRITE))
+            return;
+
+        if (Table.write[slot])
+            Table.write[slot](local_address & ~3U, value);
+        else
+            storage(local_address).store(value, std::memory_order_release);
+    }
+
+    template<typename T>
+    static T read_narrow(VirtualAddress local_address)
+    {
+        const Word shift = (local_address & (4 - sizeof(T))) * 8;
+        return T(read_word(local_address) >> shift);
+    }
+
+    template<typename T>
+    static void write_narrow(VirtualAddress local_address, T value)
+    {
+        const Word slot = (local_address & SegmentMask) >> 2;
+        if (!(Table.access[slot] & REG_WRITE))
+            return;
+
+        const Word shift = (local_address & (4 - sizeof(T))) * 8;
+        const Word mask = Word((1ULL << (sizeof(T) * 8)) - 1) << shift;
+        std::atomic_ref<Word> word = storage(local_address);
+        Word old_value = word.load(std::memory_order_acquire);
+
+        if (Table.write[slot])
+        {
+            Table.write[slot](local_address & ~3U, (old_value & ~mask) | (Word(value) << shift));
+            return;
+        }
+
+        // Device threads update the other bytes of the word with atomics too
+        Word new_value;
+        do
+        {
+            new_value = (old_value & ~mask) | (Word(value) << shift);
+        } while (!word.compare_exchange_weak(old_value, new_value, std::memory_order_acq_rel, std::memory_order_acquire));
+    }
+
+    static u8 read_byte(VirtualAddress local_address) { return read_narrow<u8>(local_address); }
+    static u16 read_half(VirtualAddress local_address) { return read_narrow<u16>(local_address); }
+
+    static DWord read_dword(VirtualAddress local_address)
+    {
+        return DWord(read_word(local_address)) | (DWord(read_word(local_address + 4)) << 32);
+    }
+
+    static QWord read_qword(VirtualAddress local_address)
+    {
+        QWord value;
+        for (Word i = 0; i < 4; i++)
+        {
+            value.w[i] = read_word(local_address + i * 4);
+        }
+        return value;
+    }
+
+    static void write_byte(VirtualAddress local_address, u8 value) { write_narrow<u8>(local_address, value); }
+    static void write_half(VirtualAddress local_address, u16 value) { write_narrow<u16>(local_address, value); }
+
+    static void write_dword(VirtualAddress local_address, DWord value)
+    {
+        write_word(local_address, Word(value));
+        write_word(local_address + 4, Word(value >> 32));
+    }
+
+    static void write_qword(VirtualAddress local_address, QWord value)
+    {
+        for (Word i = 0; i < 4; i++)
+        {
+            write_word(local_address + i * 4, value.w[i]);
+        }
+    }
+};
+
+template<VirtualAddress Base, const RegisterTable& Table>
+IODevice make_io_device(void(*initialize)(), void(*shutdown)(), void(*dispatch)())
+{
+    using Dispatch = RegisterDispatch<Base, Table>;
+
+    return IODevice
+    {
+        .base_address = Base,
+
+        .initialize = initialize,
+        .shutdown = shutdown,
+        .dispatch = dispatch,
+
+        .read_byte = &Dispatch::read_byte,
+        .read_half = &Dispatch::read_half,
+        .read_word = &Dispatch::read_word,
+        .read_dword = &Dispatch::read_dword,
+        .read_qword = &Dispatch::read_qword,
+
+        .write_byte = &Dispatch::write_byte,
+        .write_half = &Dispatch::write_half,
+        .write_word = &Dispatch::write_word,
+        .write_dword = &Dispatch::write_dword,
+        .write_qword = &Dispatch::write_qword,
+    };
+}
+
+}
@@ -0,0 +1,381 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#include "IO/SPU/SPU.h"
+
+#include "IO/DMA/DMA.h"
+#include "IO/IRQ/IRQ.h"
+#include "IO/RegisterMap.h"
+#include "Platform/OS.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <immintrin.h>
+
+
+static constexpr i32 AdpcmStepTable[89] =
+{
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+static constexpr i32 AdpcmIndexTable[16] =
+{
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+static FORCE_INLINE std::atomic_ref<Word> spu_reg(Word& reg)
+{
+    return std::atomic_ref<Word>(reg);
+}
+
+static void spu_write_voice(VirtualAddress local_address, Word value)
+{
+    const Word voice = (local_address - SPU::SPU_VOICES_START) >> 5;
+    const Word reg = (local_address & 0x1F) >> 2;
+
+    // The position is owned by the SPU
+    if (reg < 6)
+        spu_reg(SPU::get_registers().voices[voice].raw_regs[reg]).store(value, std::memory_order_relaxed);
+}
+
+static void spu_key_on(VirtualAddress, Word value)
+{
+    // Visible as playing right away, the voice starts at the next block
+    spu_reg(SPU::get_registers().voice_status).fetch_or(value & 0xFFFF, std::memory_order_release);
+    SPU::pending_key_on.fetch_or(value & 0xFFFF, std::memory_order_release);
+}
+
+static void spu_key_off(VirtualAddress, Word value)
+{
+    // The last write of a block wins, a key on still pending is dropped
+    SPU::pending_key_off.fetch_or(value & 0xFFFF, std::memory_order_release);
+    SPU::pending_key_on.fetch_and(~(value & 0xFFFF), std::memory_order_release);
+    spu_reg(SPU::get_registers().voice_status).fetch_and(~(value & 0xFFFF), std::memory_order_release);
+}
+
+static constexpr IO::RegisterInfo spu_register_map[] =
+{
+    { SPU::SPU_IRQ_MASK, 4, IO::REG_READ_WRITE, nullptr },
+    { SPU::SPU_IRQ_STATUS, 4, IO::REG_READ_WRITE, nullptr },
+    { SPU::SPU_CTR, 4, IO::REG_READ_WRITE, nullptr },
+    { SPU::SPU_ID, 4, IO::REG_READ, nullptr },
+    { SPU::SPU_MASTER_VOLUME, 4, IO::REG_READ_WRITE, nullptr },
+    { SPU::SPU_KEY_ON, 4, IO::REG_WRITE, &spu_key_on },
+    { SPU::SPU_KEY_OFF, 4, IO::REG_WRITE, &spu_key_off },
+    { SPU::SPU_VOICE_STATUS, 4, IO::REG_READ, nullptr },
+    { SPU::SPU_VOICES_START, SPU::VoiceCount * sizeof(SPU::VoiceRegisters), IO::REG_READ_WRITE, &spu_write_voice },
+};
+
+static constexpr IO::RegisterTable spu_registers = IO::make_register_table(spu_register_map);
+
+IO::IODevice SPU::get_io_device()
+{
+    return IO::make_io_device<IO::SPU_BASE, spu_registers>(&SPU::initialize, &SPU::shutdown, []() {});
+}
+
+static void wav_write_header(FILE* file, Word data_size)
+{
+    const Word channels = 2;
+    const Word bits = 16;
+    const Word byte_rate = SPU::SampleRate * channels * bits / 8;
+    const u16 block_align = u16(channels * bits / 8);
+
+    const Word riff_size = 36 + data_size;
+    const Word fmt_size = 16;
+    const u16 format = 1;
+    const u16 channel_count = u16(channels);
+    const u16 bits_per_sample = u16(bits);
+    const Word sample_rate = SPU::SampleRate;
+
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite("RIFF", 1, 4, file);
+    std::fwrite(&riff_size, 4, 1, file);
+    std::fwrite("WAVEfmt ", 1, 8, file);
+    std::fwrite(&fmt_size, 4, 1, file);
+    std::fwrite(&format, 2, 1, file);
+    std::fwrite(&channel_count, 2, 1, file);
+    std::fwrite(&sample_rate, 4, 1, file);
+    std::fwrite(&byte_rate, 4, 1, file);
+    std::fwrite(&block_align, 2, 1, file);
+    std::fwrite(&bits_per_sample, 2, 1, file);
+    std::fwrite("data", 1, 4, file);
+    std::fwrite(&data_size, 4, 1, file);
+}
+
+void SPU::initialize()
+{
+    sound_ram = (u8*)OS::allocate_virtual_memory(nullptr, SoundRamSize, OS::PAGE_READ_WRITE);
+
+    SPURegisters& regs = get_registers();
+    regs.id = SPU_1;
+    regs.master_volume = 0x1000'1000;
+    std::memset(voice_states, 0, sizeof(voice_states));
+    pending_key_on = 0;
+    pending_key_off = 0;
+
+    // Without a path (or with "null") the mixed blocks are dropped
+    if (output_path && std::strcmp(output_path, "null") != 0)
+    {
+        wav_file = std::fopen(output_path, "wb");
+        if (wav_file)
+        {
+            wav_data_size = 0;
+            wav_write_header(wav_file, 0);
+        }
+        else
+        {
+            printf("warning: cannot open audio output '%s'\n", output_path);
+        }
+    }
+
+    spu_exit = false;
+    spu_thread = std::thread(&SPU::worker);
+}
+
+void SPU::shutdown()
+{
+    spu_exit = true;
+    spu_thread.join();
+
+    if (wav_file)
+    {
+        wav_write_header(wav_file, wav_data_size);
+        std::fclose(wav_file);
+        wav_file = nullptr;
+    }
+
+    OS::deallocate_virtual_memory(sound_ram);
+    sound_ram = nullptr;
+}
+
+void SPU::worker()
+{
+    using Clock = std::chrono::steady_clock;
+    const auto block_time = std::chrono::microseconds(u64(BlockFrames) * 1'000'000 / SampleRate);
+
+    alignas(16) i16 block[BlockFrames * 2];
+    auto next_block = Clock::now();
+
+    while (!spu_exit.load(std::memory_order_acquire))
+    {
+        mix_block(block);
+        if (wav_file)
+        {
+            std::fwrite(block, sizeof(block), 1, wav_file);
+            wav_data_size += sizeof(block);
+        }
+
+        // Audio follows the host clock, a long stall doesn't produce a burst
+        next_block += block_time;
+        const auto now = Clock::now();
+        if (now - next_block > block_time * 16)
+            next_block = now;
+
+        std::this_thread::sleep_until(next_block);
+    }
+}
+
+static i16 voice_pcm16_sample(const SPU::VoiceRegisters& regs, Word index)
+{
+    const u64 address = u64(regs.start) + u64(index) * 2;
+    if (address + 2 > SPU::SoundRamSize)
+        return 0;
+
+    i16 sample;
+    std::memcpy(&sample, SPU::sound_ram + address, sizeof(i16));
+    return sample;
+}
+
+static i16 voice_adpcm_sample(SPU::Voice& voice, const SPU::VoiceRegisters& regs, Word index)
+{
+    // Going back means a loop, the decoder restarts from the state saved at the loop start
+    if (index + 1 < voice.decoded_samples)
+    {
+        const bool from_loop = index >= regs.loop_start && voice.decoded_samples > regs.loop_start;
+        voice.predictor = from_loop ? voice.loop_predictor : 0;
+        voice.step_index = from_loop ? voice.loop_step_index : 0;
+        voice.decoded_samples = from_loop ? regs.loop_start : 0;
+    }
+
+    while (voice.decoded_samples <= index)
+    {
+        const Word n = voice.decoded_samples;
+        if (n == regs.loop_start)
+        {
+            voice.loop_predictor = voice.predictor;
+            voice.loop_step_index = voice.step_index;
+        }
+
+        const u64 address = u64(regs.start) + n / 2;
+        const u8 data = address < SPU::SoundRamSize ? SPU::sound_ram[address] : 0;
+        const u8 nibble = (n & 1) ? data >> 4 : data & 0xF;
+
+        const i32 step = AdpcmStepTable[voice.step_index];
+        i32 diff = step >> 3;
+        if (nibble & 1) diff += step >> 2;
+        if (nibble & 2) diff += step >> 1;
+        if (nibble & 4) diff += step;
+
+        voice.predictor += (nibble & 8) ? -diff : diff;
+        voice.predictor = std::clamp(voice.predictor, -32768, 32767);
+        voice.step_index = std::clamp(voice.step_index + AdpcmIndexTable[nibble], 0, 88);
+
+        voice.last_sample = i16(voice.predictor);
+        voice.decoded_samples++;
+    }
+
+    return voice.last_sample;
+}
+
+void SPU::render_voice(Word index, f32* samples)
+{
+    Voice& voice = voice_states[index];
+    VoiceRegisters& live_regs = get_registers().voices[index];
+
+    VoiceRegisters regs;
+    for (Word i = 0; i < 8; i++)
+    {
+        regs.raw_regs[i] = spu_reg(live_regs.raw_regs[i]).load(std::memory_order_relaxed);
+    }
+
+    const VoiceFormat format = VoiceFormat(regs.ctr & 0x3);
+    const bool loop = (regs.ctr & VOICE_LOOP) && regs.loop_start < regs.length;
+
+    for (Word frame = 0; frame < BlockFrames; frame++)
+    {
+        if (!voice.playing)
+        {
+            samples[frame] = 0.0f;
+            continue;
+        }
+
+        Word sample_index = Word(voice.position >> 12);
+        if (sample_index >= regs.length)
+        {
+            if (!loop)
+            {
+                voice.playing = false;
+                samples[frame] = 0.0f;
+
+                const Word bit = 1U << index;
+                SPURegisters& spu_regs = get_registers();
+                spu_reg(spu_regs.voice_status).fetch_and(~bit, std::memory_order_release);
+                spu_reg(spu_regs.irq_status).fetch_or(bit, std::memory_order_release);
+                if (spu_reg(spu_regs.irq_mask).load(std::memory_order_relaxed) & bit)
+                {
+                    IRQ::raise(IRQ::IRQ_MASK_SPU);
+                }
+                continue;
+            }
+
+            const u64 loop_length = u64(regs.length - regs.loop_start) << 12;
+            voice.position = (u64(regs.loop_start) << 12) + ((voice.position - (u64(regs.length) << 12)) % loop_length);
+            sample_index = Word(voice.position >> 12);
+        }
+
+        const i16 sample = format == VOICE_FORMAT_ADPCM ?
+            voice_adpcm_sample(voice, regs, sample_index) : voice_pcm16_sample(regs, sample_index);
+
+        samples[frame] = f32(sample) * (1.0f / 32768.0f);
+        voice.position += regs.pitch & 0xFFFF;
+    }
+
+    spu_reg(live_regs.position).store(Word(voice.position >> 12), std::memory_order_relaxed);
+}
+
+void SPU::mix_block(i16* output)
+{
+    SPURegisters& regs = get_registers();
+
+    alignas(16) f32 left[BlockFrames] = {};
+    alignas(16) f32 right[BlockFrames] = {};
+    alignas(16) f32 voice_samples[BlockFrames];
+
+    const Word key_off = pending_key_off.exchange(0, std::memory_order_acquire);
+    const Word key_on = pending_key_on.exchange(0, std::memory_order_acquire);
+    for (Word i = 0; i < VoiceCount; i++)
+    {
+        const Word bit = 1U << i;
+        // spu_key_off already cleared the status, a later key on set it again
+        if (key_off & bit)
+        {
+            voice_states[i].playing = false;
+        }
+
+        if (key_on & bit)
+        {
+            voice_states[i] = {};
+            voice_states[i].playing = true;
+        }
+    }
+
+    if (spu_reg(regs.ctr).load(std::memory_order_relaxed) & SPU_ENABLE)
+    {
+        for (Word i = 0; i < VoiceCount; i++)
+        {
+            if (!voice_states[i].playing)
+                continue;
+
+            render_voice(i, voice_samples);
+
+            const Word volume = spu_reg(regs.voices[i].volume).load(std::memory_order_relaxed);
+            const __m128 volume_left = _mm_set1_ps(f32(volume & 0xFFFF) / 4096.0f);
+            const __m128 volume_right = _mm_set1_ps(f32(volume >> 16) / 4096.0f);
+
+            for (Word frame = 0; frame < BlockFrames; frame += 4)
+            {
+                const __m128 sample = _mm_load_ps(voice_samples + frame);
+                _mm_store_ps(left + frame, _mm_add_ps(_mm_load_ps(left + frame), _mm_mul_ps(sample, volume_left)));
+                _mm_store_ps(right + frame, _mm_add_ps(_mm_load_ps(right + frame), _mm_mul_ps(sample, volume_right)));
+            }
+        }
+    }
+
+    const Word master = spu_reg(regs.master_volume).load(std::memory_order_relaxed);
+    const __m128 master_left = _mm_set1_ps(f32(master & 0xFFFF) / 4096.0f * 32767.0f);
+    const __m128 master_right = _mm_set1_ps(f32(master >> 16) / 4096.0f * 32767.0f);
+
+    // Interleave as L R L R, packs saturates to the i16 range
+    for (Word frame = 0; frame < BlockFrames; frame += 4)
+    {
+        const __m128i l = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(left + frame), master_left));
+        const __m128i r = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(right + frame), master_right));
+        const __m128i stereo = _mm_packs_epi32(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r));
+        _mm_store_si128((__m128i*)(output + frame * 2), stereo);
+    }
+}
+
+bool SPU::dma_send(VirtualAddress dest, VirtualAddress src, Word bytes, Word flags)
+{
+    switch (DMA::get_direction(flags))
+    {
+    case DMA::DMA_RAM_TO_DEVICE:
+        if (u64(dest) + bytes > SoundRamSize)
+            return false;
+
+        return Bus::read_block(src, sound_ram + dest, bytes);
+    case DMA::DMA_DEVICE_TO_RAM:
+        if (u64(src) + bytes > SoundRamSize)
+            return false;
+
+        return Bus::write_block(dest, sound_ram + src, bytes);
+    case DMA::DMA_DEVICE_TO_DEVICE:
+        if (u64(src) + bytes > SoundRamSize || u64(dest) + bytes > SoundRamSize)
+            return false;
+
+        std::memmove(sound_ram + dest, sound_ram + src, bytes);
+        return true;
+    }
+
+    return false;
+}
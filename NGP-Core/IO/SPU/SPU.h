@@ -0,0 +1,181 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#pragma once
+#include "IO/IO.h"
+#include "Memory/Bus.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+struct CPUCore;
+
+struct SPU
+{
+    static constexpr Word SoundRamSize = KB(512);
+    static constexpr Word VoiceCount = 16;
+    static constexpr Word SampleRate = 48000;
+    // Frames mixed at once by the SPU thread
+    static constexpr Word BlockFrames = 256;
+
+    enum Register
+    {
+        // SPU Interrupt Mask
+        // [0 - 15] Voice reached its end without loop
+        SPU_IRQ_MASK =      0x000,
+        SPU_IRQ_STATUS =    0x004,
+        // SPU Control
+        // [0] Enable output
+        SPU_CTR =           0x008,
+        SPU_ID =            0x00C,
+
+        // [0 - 15] Left volume, [16 - 31] Right volume, 4.12 fixed point
+        SPU_MASTER_VOLUME = 0x010,
+        // [0 - 15] Voices to start, write only
+        SPU_KEY_ON =        0x014,
+        // [0 - 15] Voices to stop, write only
+        SPU_KEY_OFF =       0x018,
+        // [0 - 15] Playing voices, read only
+        SPU_VOICE_STATUS =  0x01C,
+
+        // 16 voices of 32 bytes each
+        SPU_VOICES_START =  0x100,
+        SPU_VOICES_END =    0x2FF,
+    };
+
+    // Voice Registers
+    // 0x00 Control:
+    //      [0 - 1] Format: 0(PCM16), 1(IMA ADPCM, 4 bits, low nibble first)
+    //      [2] Loop
+    // 0x04 Start: sample data address in sound RAM
+    // 0x08 Length: in samples
+    // 0x0C Loop Start: in samples, IMA ADPCM restarts the decoder state saved there
+    // 0x10 Pitch: 4.12 fixed point, 0x1000 plays at 48 KHz
+    // 0x14 Volume: [0 - 15] Left, [16 - 31] Right, 4.12 fixed point
+    // 0x18 Position: current sample, read only
+    enum VoiceRegister
+    {
+        VOICE_CTR = 0x0,
+        VOICE_START = 0x4,
+        VOICE_LENGTH = 0x8,
+        VOICE_LOOP_START = 0xC,
+        VOICE_PITCH = 0x10,
+        VOICE_VOLUME = 0x14,
+        VOICE_POSITION = 0x18,
+    };
+
+    enum SPUControlBit
+    {
+        SPU_ENABLE = 0x1,
+    };
+
+    enum SPUID
+    {
+        SPU_1 = 0,
+    };
+
+    enum VoiceFormat
+    {
+        VOICE_FORMAT_PCM16 = 0x0,
+        VOICE_FORMAT_ADPCM = 0x1,
+    };
+
+    enum VoiceControlBit
+    {
+        VOICE_LOOP = 0x4,
+    };
+
+    union VoiceRegisters
+    {
+        struct
+        {
+            Word ctr;
+            Word start;
+            Word length;
+            Word loop_start;
+            Word pitch;
+            Word volume;
+            Word position;
+            Word reserved;
+        };
+
+        Word raw_regs[8];
+    };
+
+    struct SPURegisters
+    {
+        // 0x000
+        Word irq_mask;
+        Word irq_status;
+        Word ctr;
+        Word id;
+
+        // 0x010
+        Word master_volume;
+        Word key_on;
+        Word key_off;
+        Word voice_status;
+
+        u8 reserved[0x100 - 0x20];
+
+        // 0x100
+        VoiceRegisters voices[VoiceCount];
+    };
+
+    // Playback state, owned by the SPU thread
+    struct Voice
+    {
+        bool playing;
+        // 20.12 fixed point sample position
+        u64 position;
+
+        // IMA ADPCM decoder
+        i32 predictor;
+        i32 step_index;
+        Word decoded_samples;
+        i32 loop_predictor;
+        i32 loop_step_index;
+        i16 last_sample;
+    };
+
+    enum SinkType
+    {
+        SINK_NULL = 0,
+        SINK_WAV,
+    };
+
+    static inline u8* sound_ram = nullptr;
+    static inline Voice voice_states[VoiceCount];
+
+    // Written by the core, consumed by the SPU thread at every block
+    static inline std::atomic<Word> pending_key_on = 0;
+    static inline std::atomic<Word> pending_key_off = 0;
+
+    static inline std::thread spu_thread;
+    static inline std::atomic<bool> spu_exit = false;
+
+    // -audio <path>, null keeps the output silent
+    static inline const char* output_path = nullptr;
+    static inline FILE* wav_file = nullptr;
+    static inline Word wav_data_size = 0;
+
+    static IO::IODevice get_io_device();
+    static SPURegisters& get_registers()
+    {
+        return *(SPURegisters*)(Bus::MAPPED_BUS_ADDRESS_START + IO::SPU_BASE);
+    }
+
+    static void initialize();
+    static void shutdown();
+
+    static void worker();
+    static void mix_block(i16* output);
+    static void render_voice(Word index, f32* samples);
+
+    // DMA SPU channel, the device address is an offset in sound RAM
+    static bool dma_send(VirtualAddress dest, VirtualAddress src, Word bytes, Word flags);
+};
@@ -6,59 +6,166 @@
 /******************************************************/
 #include "IO/USI/USI.h"
 
+#include "IO/IRQ/IRQ.h"
+#include "IO/RegisterMap.h"
+
+#include <cstdio>
+
+
+static constexpr IO::RegisterInfo usi_register_map[] =
+{
+    { USI::USI_IRQ_MASK, 4, IO::REG_READ_WRITE, nullptr },
+    { USI::USI_IRQ_STATUS, 4, IO::REG_READ_WRITE, nullptr },
+    { USI::USI_CTR, 4, IO::REG_READ_WRITE, nullptr },
+    { USI::USI_ID, 4, IO::REG_READ, nullptr },
+    { USI::USI_CMD, 4, IO::REG_READ_WRITE, &USI::write_cmd },
+    { USI::USI_ADDR, 4, IO::REG_READ_WRITE, nullptr },
+    { USI::USI_BLOCK_ADDR, 4, IO::REG_READ_WRITE, nullptr },
+    { USI::USI_PORT_SELECT, 4, IO::REG_READ_WRITE, nullptr },
+    { USI::USI_STATUS, 4, IO::REG_READ, nullptr },
+    { USI::USI_SECTOR_COUNT, 4, IO::REG_READ, nullptr },
+};
+
+static constexpr IO::RegisterTable usi_registers = IO::make_register_table(usi_register_map);
+
 IO::IODevice USI::get_io_device()
 {
-	return IO::IODevice
-	{
-		.base_address = IO::DMA_BASE,
-
-		.initialize = &USI::initialize,
-		.shutdown = &USI::shutdown,
-		.dispatch = &USI::dispatch,
-
-        .read_byte = [](VirtualAddress) -> u8 { return 0; },
-        .read_half = [](VirtualAddress) -> u16 { return 0; },
-        .read_word = [](VirtualAddress) -> Word { return 0; },
-        .read_dword = [](VirtualAddress) -> DWord { return 0; },
-        .read_qword = [](VirtualAddress) -> QWord { return QWord(); },
-
-        .write_byte = [](VirtualAddress, u8) {},
-        .write_half = [](VirtualAddress, u16) {},
-        .write_word = &USI::handle_write_word,
-        .write_dword = [](VirtualAddress, DWord) {},
-        .write_qword = [](VirtualAddress, QWord) {},
-	};
+    return IO::make_io_device<IO::USI_BASE, usi_registers>(&USI::initialize, &USI::shutdown, &USI::dispatch);
+}
+
+static FORCE_INLINE std::atomic_ref<Word> usi_reg(Word& reg)
+{
+    return std::atomic_ref<Word>(reg);
+}
+
+void USI::initialize()
+{
+    get_registers().id = USI_1;
+
+    if (disk_path && !USIDisk::open(disk_path))
+    {
+        printf("warning: cannot open disk image '%s'\n", disk_path);
+    }
+
+    get_registers().sector_count = USIDisk::sector_count;
+
+    usi_exit = false;
+    requests.clear();
+    usi_thread = std::thread(&USI::worker);
+}
+
+void USI::shutdown()
+{
+    usi_exit = true;
+    request_counter.fetch_add(1, std::memory_order_release);
+    request_counter.notify_one();
+    usi_thread.join();
+
+    // Guest writes reach the overlay file here
+    if (USIDisk::is_open())
+    {
+        USIDisk::close();
+    }
 }
 
-void USI::initialize() {}
-void USI::shutdown() {}
 void USI::dispatch() {}
 
-void USI::handle_write_word(VirtualAddress local_addr, Word value)
+void USI::worker()
 {
-    switch (local_addr)
+    while (!usi_exit.load(std::memory_order_acquire))
     {
-    case USI_IRQ_MASK:
-        get_registers().irq_mask = value;
-        break;
-    case USI_IRQ_STATUS:
-        break;
-    case USI_CTR:
-        get_registers().ctr = value;
-        break;
-    case USI_ID:
-        break;
-    case USI_CMD:
-        get_registers().cmd = value;
-        break;
-    case USI_ADDR:
-        get_registers().addr = value;
-        break;
-    case USI_BLOCK_ADDR:
-        get_registers().block_addr = value;
-        break;
-    case USI_PORT_SELECT:
-        get_registers().port_select = value;
+        const Word seen_requests = request_counter.load(std::memory_order_acquire);
+
+        USIRequest request;
+        if (!requests.pop(request))
+        {
+            request_counter.wait(seen_requests, std::memory_order_acquire);
+            continue;
+        }
+
+        const USIStatus status = execute(request);
+
+        USIRegisters& regs = get_registers();
+        usi_reg(regs.status).store(status, std::memory_order_relaxed);
+        usi_reg(regs.cmd).fetch_and(~Word(USI_CMD_BUSY), std::memory_order_release);
+
+        usi_reg(regs.irq_status).fetch_or(USI_IRQ_MASK_READ_WRITE_FINISHED, std::memory_order_release);
+        if (usi_reg(regs.irq_mask).load(std::memory_order_relaxed) & USI_IRQ_MASK_READ_WRITE_FINISHED)
+        {
+            IRQ::raise(IRQ::IRQ_MASK_USI);
+        }
+    }
+}
+
+USI::USIStatus USI::execute(const USIRequest& request)
+{
+    const USICommand command = USICommand(request.cmd & 0xFF);
+    const Word sectors = (request.cmd >> 8) & 0xFFFF;
+
+    if (command == USI_CMD_NOP)
+        return USI_STATUS_OK;
+
+    if (!USIDisk::is_open())
+        return USI_STATUS_NO_DEVICE;
+
+    const u64 offset = u64(request.block_addr) * SectorSize;
+    const Word size = sectors * SectorSize;
+    if (offset + size > USIDisk::size)
+        return USI_STATUS_BAD_SECTOR;
+
+    // Reported to the watchpoints and the profiler like every other bulk access
+    switch (command)
+    {
+    case USI_CMD_READ:
+        if (!Bus::check_block(request.addr, size, Bus::PageWrite))
+            return USI_STATUS_BAD_ADDRESS;
+
+        return USIDisk::read(offset, (void*)Bus::get_physical_addr(request.addr), size) ? USI_STATUS_OK : USI_STATUS_IO_ERROR;
+    case USI_CMD_WRITE:
+        if (!Bus::check_block(request.addr, size, Bus::PageRead))
+            return USI_STATUS_BAD_ADDRESS;
+
+        return USIDisk::write(offset, (const void*)Bus::get_physical_addr(request.addr), size) ? USI_STATUS_OK : USI_STATUS_IO_ERROR;
+    default:
         break;
     }
+
+    return USI_STATUS_BAD_COMMAND;
+}
+
+bool USI::read_disk(u64 offset, VirtualAddress dst, Word size)
+{
+    if (!USIDisk::is_open() || !Bus::check_block(dst, size, Bus::PageWrite))
+        return false;
+
+    // Sectors are copied straight into guest memory
+    return USIDisk::read(offset, (void*)Bus::get_physical_addr(dst), size);
+}
+
+bool USI::write_disk(u64 offset, VirtualAddress src, Word size)
+{
+    if (!USIDisk::is_open() || !Bus::check_block(src, size, Bus::PageRead))
+        return false;
+
+    return USIDisk::write(offset, (const void*)Bus::get_physical_addr(src), size);
+}
+
+void USI::write_cmd(VirtualAddress, Word value)
+{
+    USIRegisters& regs = get_registers();
+    if (!(value & USI_CMD_BUSY) || (usi_reg(regs.cmd).load(std::memory_order_acquire) & USI_CMD_BUSY))
+        return;
+
+    usi_reg(regs.cmd).store(value, std::memory_order_release);
+    const Word addr = usi_reg(regs.addr).load(std::memory_order_acquire);
+    const Word block_addr = usi_reg(regs.block_addr).load(std::memory_order_acquire);
+    if (!requests.push(USIRequest{ value, addr, block_addr }))
+    {
+        // Only one command is in flight, the ring can't be full
+        usi_reg(regs.cmd).fetch_and(~Word(USI_CMD_BUSY), std::memory_order_release);
+        return;
+    }
+
+    request_counter.fetch_add(1, std::memory_order_release);
+    request_counter.notify_one();
 }
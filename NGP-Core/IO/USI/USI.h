@@ -5,12 +5,19 @@
 /*        See the LICENSE in the project root.        */
 /******************************************************/
 #pragma once
+#include "Core/RingBuffer.h"
 #include "IO/IO.h"
+#include "IO/USI/USIDisk.h"
 #include "Memory/Bus.h"
 
+#include <atomic>
+#include <thread>
+
 
 struct USI
 {
+	static constexpr Word SectorSize = USIDisk::SectorSize;
+
 	enum Register
 	{
 		// USI Interrupt Mask
@@ -21,14 +28,24 @@ struct USI
 		USI_IRQ_STATUS = 0x004,
 		// USI Control Register
 		// [0] Reset
-		USI_CTR =		0x00C,
-		USI_ID =		0x008,
+		USI_CTR =		0x008,
+		USI_ID =		0x00C,
 
 		// USI Command
+		// [0 - 7] Command
+		// [8 - 23] Sector count
+		// [31] Start / Busy
 		USI_CMD =			0x010,
+		// RAM address of the transfer
 		USI_ADDR =			0x014,
+		// First sector of the transfer
 		USI_BLOCK_ADDR =	0x018,
 		USI_PORT_SELECT =	0x01C,
+
+		// Result of the last command, read only
+		USI_STATUS =		0x020,
+		// Sectors in the inserted disk, read only
+		USI_SECTOR_COUNT =	0x024,
 	};
 
 	enum USIRQMask
@@ -48,6 +65,30 @@ struct USI
 		USI_1 = 0,
 	};
 
+	enum USICommand
+	{
+		USI_CMD_NOP = 0x0,
+		// Disk -> RAM
+		USI_CMD_READ = 0x1,
+		// RAM -> Disk
+		USI_CMD_WRITE = 0x2,
+	};
+
+	enum USICommandBit
+	{
+		USI_CMD_BUSY = 0x8000'0000,
+	};
+
+	enum USIStatus
+	{
+		USI_STATUS_OK = 0x0,
+		USI_STATUS_NO_DEVICE = 0x1,
+		USI_STATUS_BAD_ADDRESS = 0x2,
+		USI_STATUS_BAD_SECTOR = 0x3,
+		USI_STATUS_IO_ERROR = 0x4,
+		USI_STATUS_BAD_COMMAND = 0x5,
+	};
+
 	struct USIRegisters
 	{
 		// 0x000
@@ -61,8 +102,27 @@ struct USI
 		Word addr;
 		Word block_addr;
 		Word port_select;
+
+		// 0x020
+		Word status;
+		Word sector_count;
 	};
 
+	// Commands are copied at the kick and serviced by the USI thread
+	struct USIRequest
+	{
+		Word cmd;
+		Word addr;
+		Word block_addr;
+	};
+
+	static inline const char* disk_path = nullptr;
+
+	static inline RingBuffer<USIRequest, 16> requests;
+	static inline std::atomic<Word> request_counter = 0;
+	static inline std::thread usi_thread;
+	static inline std::atomic<bool> usi_exit = false;
+
 	static IO::IODevice get_io_device();
 	static USIRegisters& get_registers()
 	{
@@ -73,7 +133,13 @@ struct USI
 	static void shutdown();
 
 	static void dispatch();
+	static void worker();
+	static USIStatus execute(const USIRequest& request);
+
+	// Used by the DMA USI channel, the device address is a byte offset in the disk
+	static bool read_disk(u64 offset, VirtualAddress dst, Word size);
+	static bool write_disk(u64 offset, VirtualAddress src, Word size);
 
-	static void handle_write_word(VirtualAddress local_address, Word value);
+	static void write_cmd(VirtualAddress local_address, Word value);
 
-};
\ No newline at end of file
+};
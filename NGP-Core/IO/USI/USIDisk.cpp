@@ -0,0 +1,269 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#include "IO/USI/USIDisk.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+
+bool USIDisk::open(const char* path)
+{
+    base_file = OS::open_file(path, false);
+    if (base_file == OS::InvalidFile)
+        return false;
+
+    sector_count = Word(OS::get_file_size(base_file) / SectorSize);
+    size = u64(sector_count) * SectorSize;
+    if (size == 0)
+    {
+        close();
+        return false;
+    }
+
+    // Without a mapping the sectors are read from the file
+    base_view = (const u8*)OS::map_file(nullptr, path, size, OS::PAGE_READ_ONLY);
+    if (!base_view)
+    {
+        printf("warning: cannot map disk image '%s', using file reads\n", path);
+    }
+
+    const Word bitmap_bytes = (sector_count + 7) / 8;
+    bitmap_sectors = (bitmap_bytes + SectorSize - 1) / SectorSize;
+    overlay_bitmap.assign(usize(bitmap_sectors) * SectorSize, 0);
+    overlay_sectors = 0;
+
+    overlay_path = std::string(path) + ".overlay";
+    overlay_file = OS::open_file(overlay_path.c_str(), true);
+    if (overlay_file != OS::InvalidFile)
+    {
+        OverlayHeader header = {};
+        if (!OS::read_file_at(overlay_file, 0, &header, sizeof(OverlayHeader)) ||
+            std::memcmp(header.magic, "NGPO", 4) != 0 || header.version != OverlayVersion ||
+            header.sector_count != sector_count || header.bitmap_sectors != bitmap_sectors ||
+            !OS::read_file_at(overlay_file, SectorSize, overlay_bitmap.data(), overlay_bitmap.size()))
+        {
+            printf("warning: overlay '%s' doesn't match the disk image, it will be replaced\n", overlay_path.c_str());
+            std::fill(overlay_bitmap.begin(), overlay_bitmap.end(), 0);
+        }
+
+        for (Word sector = 0; sector < sector_count; sector++)
+        {
+            overlay_sectors += in_overlay(sector);
+        }
+    }
+
+    next_offset = 0;
+    sequential_count = 0;
+    random_count = 0;
+    current_advice = OS::ADVICE_NORMAL;
+    return true;
+}
+
+void USIDisk::close()
+{
+    flush();
+
+    if (base_view)
+    {
+        OS::unmap_file((void*)base_view, size);
+        base_view = nullptr;
+    }
+
+    if (base_file != OS::InvalidFile)
+    {
+        OS::close_file(base_file);
+        base_file = OS::InvalidFile;
+    }
+
+    if (overlay_file != OS::InvalidFile)
+    {
+        OS::close_file(overlay_file);
+        overlay_file = OS::InvalidFile;
+    }
+
+    overlay_bitmap.clear();
+    overlay_sectors = 0;
+    size = 0;
+    sector_count = 0;
+}
+
+bool USIDisk::flush()
+{
+    std::lock_guard lock{ disk_mutex };
+    if (dirty_sectors.empty())
+        return true;
+
+    if (overlay_file == OS::InvalidFile)
+    {
+        overlay_file = OS::create_file(overlay_path.c_str());
+        if (overlay_file == OS::InvalidFile)
+        {
+            printf("error: cannot create disk overlay '%s', guest writes are lost\n", overlay_path.c_str());
+            return false;
+        }
+    }
+
+    // Data first, the bitmap only marks sectors that are already on disk
+    bool success = true;
+    for (const auto& [sector, data] : dirty_sectors)
+    {
+        success &= OS::write_file_at(overlay_file, get_overlay_slot(sector), data.get(), SectorSize);
+    }
+
+    OverlayHeader header = { { 'N', 'G', 'P', 'O' }, OverlayVersion, sector_count, bitmap_sectors };
+    success &= OS::write_file_at(overlay_file, 0, &header, sizeof(OverlayHeader));
+    success &= OS::write_file_at(overlay_file, SectorSize, overlay_bitmap.data(), overlay_bitmap.size());
+
+    if (!success)
+    {
+        printf("error: cannot write disk overlay '%s'\n", overlay_path.c_str());
+        return false;
+    }
+
+    dirty_sectors.clear();
+    return true;
+}
+
+bool USIDisk::read_sector(Word sector, Word sector_offset, u8* dst, Word length)
+{
+    if (in_overlay(sector))
+    {
+        auto dirty = dirty_sectors.find(sector);
+        if (dirty != dirty_sectors.end())
+        {
+            std::memcpy(dst, dirty->second.get() + sector_offset, length);
+            return true;
+        }
+
+        return OS::read_file_at(overlay_file, get_overlay_slot(sector) + sector_offset, dst, length);
+    }
+
+    const u64 offset = u64(sector) * SectorSize + sector_offset;
+    if (base_view)
+    {
+        std::memcpy(dst, base_view + offset, length);
+        return true;
+    }
+
+    return OS::read_file_at(base_file, offset, dst, length);
+}
+
+bool USIDisk::read(u64 offset, void* dst, usize length)
+{
+    if (offset + length > size)
+        return false;
+
+    std::lock_guard lock{ disk_mutex };
+    advise(offset, length);
+
+    // Nothing was written, the whole range comes from the base image
+    if (overlay_sectors == 0 && base_view)
+    {
+        std::memcpy(dst, base_view + offset, length);
+        return true;
+    }
+
+    u8* out = (u8*)dst;
+    while (length)
+    {
+        const Word sector = Word(offset / SectorSize);
+        const Word sector_offset = Word(offset % SectorSize);
+        const Word piece = Word(std::min<usize>(length, SectorSize - sector_offset));
+
+        if (!read_sector(sector, sector_offset, out, piece))
+            return false;
+
+        out += piece;
+        offset += piece;
+        length -= piece;
+    }
+
+    return true;
+}
+
+bool USIDisk::write(u64 offset, const void* src, usize length)
+{
+    if (offset + length > size)
+        return false;
+
+    std::lock_guard lock{ disk_mutex };
+    advise(offset, length);
+
+    const u8* in = (const u8*)src;
+    while (length)
+    {
+        const Word sector = Word(offset / SectorSize);
+        const Word sector_offset = Word(offset % SectorSize);
+        const Word piece = Word(std::min<usize>(length, SectorSize - sector_offset));
+
+        // The first write of a sector copies its current contents
+        auto& data = dirty_sectors[sector];
+        if (!data)
+        {
+            data = std::make_unique<u8[]>(SectorSize);
+            if (piece != SectorSize && !read_sector(sector, 0, data.get(), SectorSize))
+            {
+                dirty_sectors.erase(sector);
+                return false;
+            }
+
+            if (!in_overlay(sector))
+            {
+                overlay_bitmap[sector >> 3] |= 1 << (sector & 0x7);
+                overlay_sectors++;
+            }
+        }
+
+        std::memcpy(data.get() + sector_offset, in, piece);
+
+        in += piece;
+        offset += piece;
+        length -= piece;
+    }
+
+    return true;
+}
+
+void USIDisk::advise(u64 offset, usize length)
+{
+    if (offset == next_offset)
+    {
+        sequential_count++;
+        random_count = 0;
+    }
+    else
+    {
+        random_count++;
+        sequential_count = 0;
+    }
+    next_offset = offset + length;
+
+    if (!base_view)
+        return;
+
+    OS::MemoryAdvice advice = current_advice;
+    if (sequential_count >= SequentialThreshold)
+        advice = OS::ADVICE_SEQUENTIAL;
+    else if (random_count >= SequentialThreshold)
+        advice = OS::ADVICE_RANDOM;
+    else if (sequential_count == 0 && current_advice == OS::ADVICE_SEQUENTIAL)
+        advice = OS::ADVICE_NORMAL;
+
+    if (advice != current_advice)
+    {
+        OS::advise_memory((void*)base_view, size, advice);
+        current_advice = advice;
+    }
+
+    // Streaming reads prefetch the sectors that come next
+    if (advice == OS::ADVICE_SEQUENTIAL && next_offset < size)
+    {
+        const u64 read_ahead = std::min<u64>(u64(ReadAheadSectors) * SectorSize, size - next_offset);
+        OS::advise_memory((void*)(base_view + next_offset), usize(read_ahead), OS::ADVICE_WILLNEED);
+    }
+}
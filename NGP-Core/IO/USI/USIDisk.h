@@ -0,0 +1,82 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#pragma once
+#include "Core/Header.h"
+#include "Platform/OS.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Disk image behind the USI port. The base image is mapped read only and
+// shared by every instance, guest writes go to a copy-on-write overlay.
+// Overlay file layout, next to the image as "<image>.overlay":
+//   sector 0: OverlayHeader
+//   then the sector bitmap, one bit per image sector, rounded to sectors
+//   then one slot per image sector, only written slots use disk space
+struct USIDisk
+{
+    static constexpr Word SectorSize = 4096;
+    static constexpr Word OverlayVersion = 1;
+    // Consecutive requests before the mapping is read sequentially
+    static constexpr Word SequentialThreshold = 4;
+    static constexpr Word ReadAheadSectors = 64;
+
+    struct OverlayHeader
+    {
+        // Always "NGPO"
+        char magic[4];
+        Word version;
+        Word sector_count;
+        Word bitmap_sectors;
+    };
+
+    static inline std::string overlay_path;
+    static inline OS::FileHandle base_file = OS::InvalidFile;
+    static inline OS::FileHandle overlay_file = OS::InvalidFile;
+    static inline const u8* base_view = nullptr;
+    static inline u64 size = 0;
+    static inline Word sector_count = 0;
+    static inline Word bitmap_sectors = 0;
+
+    // Sectors owned by the overlay, the ones written since the last flush are in memory
+    static inline std::vector<u8> overlay_bitmap;
+    static inline Word overlay_sectors = 0;
+    static inline std::unordered_map<Word, std::unique_ptr<u8[]>> dirty_sectors;
+    static inline std::mutex disk_mutex;
+
+    // Access pattern tracking for the paging hints
+    static inline u64 next_offset = 0;
+    static inline Word sequential_count = 0;
+    static inline Word random_count = 0;
+    static inline OS::MemoryAdvice current_advice = OS::ADVICE_NORMAL;
+
+    static bool open(const char* path);
+    static void close();
+    static bool flush();
+
+    static bool is_open() { return size != 0; }
+
+    static bool read(u64 offset, void* dst, usize length);
+    static bool write(u64 offset, const void* src, usize length);
+
+    // Internal functions
+    static bool in_overlay(Word sector)
+    {
+        return overlay_bitmap[sector >> 3] & (1 << (sector & 0x7));
+    }
+
+    static u64 get_overlay_slot(Word sector)
+    {
+        return (u64(1) + bitmap_sectors + sector) * SectorSize;
+    }
+
+    static bool read_sector(Word sector, Word sector_offset, u8* dst, Word length);
+    static void advise(u64 offset, usize length);
+};
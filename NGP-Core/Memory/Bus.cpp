@@ -8,11 +8,16 @@
 
 #include "Bus.h"
 #include "Core/Header.h"
+#include "Core/HostMemory.h"
 #include "IO/IO.h"
 #include "CPU/CPUCore.h"
 #include "Emulator.h"
+#include "Memory/MemoryProfiler.h"
 #include "Platform/OS.h"
+#include <atomic>
+#include <cstring>
 #include <fstream>
+#include <type_traits>
 
 extern thread_local Emulator::ThreadCore* local_core;
 
@@ -52,6 +57,8 @@ void Bus::initialize()
         }
     }
 
+    update_watch_pages(0, PageCount - 1);
+
 #if !NDEBUG
     printf("DEBUG: BIOS mapped at: 0x%016llX\n", u64(bios));
     printf("DEBUG: IO mapped at:   0x%016llX\n", u64(io));
@@ -65,7 +72,16 @@ void Bus::initialize()
 
 void Bus::shutdown()
 {
-    OS::deallocate_virtual_memory((void*)bios);
+    if (bios_file_mapped)
+    {
+        OS::unmap_file((void*)bios, BIOS_SIZE);
+        bios_file_mapped = false;
+    }
+    else
+    {
+        OS::deallocate_virtual_memory((void*)bios);
+    }
+
     OS::deallocate_virtual_memory((void*)io);
     OS::deallocate_virtual_memory((void*)ram);
 }
@@ -80,7 +96,12 @@ void Bus::invalid_write(VirtualAddress addr)
     local_core->get_core().external_handle_exception(CPUCore::AccessViolationException, CPUCore::CantWrite, addr);
 }
 
-bool Bus::load_bios(const char* path)
+void Bus::invalid_alignment(VirtualAddress addr)
+{
+    local_core->get_core().external_handle_exception(CPUCore::BadMemAlignment, CPUCore::CommentNone, addr);
+}
+
+bool Bus::load_bios(const char* path, bool map_file)
 {
     std::ifstream file{ path, std::ios::binary | std::ios::ate };
     if (!file.is_open())
@@ -95,6 +116,29 @@ bool Bus::load_bios(const char* path)
         return false;
     }
 
+    if (map_file)
+    {
+        // Replace the anonymous BIOS pages with a private view of the file, the page
+        // cache is shared between instances and a page is only copied when written.
+        OS::deallocate_virtual_memory((void*)bios);
+        PhysicalAddress view = (PhysicalAddress)OS::map_file((void*)MAPPED_BUS_ADDRESS_START, path, BIOS_SIZE, OS::PAGE_READ_WRITE);
+        if (view == MAPPED_BUS_ADDRESS_START)
+        {
+            bios = view;
+            bios_file_mapped = true;
+            file.close();
+            return true;
+        }
+
+        if (view)
+        {
+            OS::unmap_file((void*)view, BIOS_SIZE);
+        }
+
+        printf("warning: cannot map bios file '%s', loading a private copy\n", path);
+        bios = (PhysicalAddress)OS::allocate_virtual_memory((void*)MAPPED_BUS_ADDRESS_START, BIOS_SIZE, OS::PAGE_READ_WRITE);
+    }
+
     file.read((char*)bios, size);
 
     file.close();
@@ -102,13 +146,223 @@ bool Bus::load_bios(const char* path)
     return true;
 }
 
+bool Bus::add_watchpoint(VirtualAddress address, Word size, PageAccess access)
+{
+    access = PageAccess(access & (PageRead | PageWrite));
+    if (size == 0 || access == PageNone || u64(address) + size > 0x1'0000'0000)
+        return false;
+
+    {
+        std::lock_guard lock{ watch_mutex };
+        watchpoints.emplace_back(Watchpoint{ address, size, access });
+    }
+
+    update_watch_pages(get_page_index(address), get_page_index(address + size - 1));
+    return true;
+}
+
+void Bus::remove_watchpoint(VirtualAddress address, Word size)
+{
+    {
+        std::lock_guard lock{ watch_mutex };
+        std::erase_if(watchpoints, [&](const Watchpoint& wp) { return wp.address == address && wp.size == size; });
+    }
+
+    if (size != 0)
+        update_watch_pages(get_page_index(address), get_page_index(address + size - 1));
+}
+
+void Bus::clear_watchpoints()
+{
+    {
+        std::lock_guard lock{ watch_mutex };
+        watchpoints.clear();
+    }
+
+    update_watch_pages(0, PageCount - 1);
+}
+
+void Bus::update_watch_pages(Word first_page, Word last_page)
+{
+    std::lock_guard lock{ watch_mutex };
+
+    for (Word page = first_page; page <= last_page; page++)
+    {
+        Page& entry = page_table[page];
+        Word access = get_page_access(entry) & ~Word(PageWatchRead | PageWatchWrite);
+
+        const VirtualAddress page_start = page << PageBits;
+        for (const Watchpoint& wp : watchpoints)
+        {
+            if (u64(wp.address) + wp.size <= page_start || u64(wp.address) >= u64(page_start) + PageSize)
+                continue;
+
+            // Move the watched access to its watch bit
+            const Word watched = access & wp.access;
+            access = (access & ~watched) | (watched << 3);
+        }
+
+        entry.access = PageAccess(access);
+    }
+}
+
+void Bus::hit_watchpoints(VirtualAddress address, Word size, PageAccess access)
+{
+    bool hit = false;
+    {
+        std::lock_guard lock{ watch_mutex };
+        for (const Watchpoint& wp : watchpoints)
+        {
+            if ((wp.access & access) && u64(address) < u64(wp.address) + wp.size && u64(address) + size > wp.address)
+            {
+                hit = true;
+                break;
+            }
+        }
+    }
+
+    // Reported outside of the lock, so the handler can change the watchpoints
+    if (hit)
+        Emulator::handle_readwrite_interrupt(address, access == PageRead);
+}
+
+static bool check_range_access(VirtualAddress va, Word size, Bus::PageAccess access, bool& watched)
+{
+    watched = false;
+    if (size == 0)
+        return true;
+
+    const u64 end = u64(va) + size;
+    if (end > 0x1'0000'0000)
+        return false;
+
+    const Word first_page = Bus::get_page_index(va);
+    const Word last_page = Bus::get_page_index(VirtualAddress(end - 1));
+    for (Word page = first_page; page <= last_page; page++)
+    {
+        const Bus::Page& entry = Bus::page_table[page];
+        if ((Bus::get_page_access(entry) & access) != access)
+            return false;
+
+        // IO writes have side effects, they must go through the IO devices
+        if ((access & Bus::PageWrite) && (entry.page_address >> 28) == 1)
+            return false;
+
+        watched |= (entry.access & (access << 3)) != 0;
+    }
+
+    return true;
+}
+
+// Validates the range and reports it to the watchpoints if it crosses a watched page
+bool Bus::check_block(VirtualAddress va, Word size, PageAccess access)
+{
+    bool watched;
+    if (!check_range_access(va, size, access, watched))
+        return false;
+
+    if (watched) [[unlikely]]
+        hit_watchpoints(va, size, access);
+
+#if NGP_MEMORY_PROFILER
+    MemoryProfiler::record_range(va, size, access == PageRead ? MemoryProfiler::Read : MemoryProfiler::Write);
+#endif // NGP_MEMORY_PROFILER
+
+    return true;
+}
+
+bool Bus::check_range(VirtualAddress va, Word size, PageAccess access)
+{
+    bool watched;
+    return check_range_access(va, size, access, watched);
+}
+
+bool Bus::copy_range(VirtualAddress dst, VirtualAddress src, Word size)
+{
+    if (!check_block(src, size, PageRead) || !check_block(dst, size, PageWrite))
+        return false;
+
+    std::memmove((void*)get_physical_addr(dst), (void*)get_physical_addr(src), size);
+    return true;
+}
+
+bool Bus::fill_range(VirtualAddress dst, u8 value, Word size)
+{
+    if (!check_block(dst, size, PageWrite))
+        return false;
+
+    std::memset((void*)get_physical_addr(dst), value, size);
+    return true;
+}
+
+bool Bus::fill_range_word(VirtualAddress dst, Word pattern, Word size)
+{
+    if (!check_block(dst, size, PageWrite))
+        return false;
+
+    HostMemory::fill_word((void*)get_physical_addr(dst), pattern, size);
+    return true;
+}
+
+bool Bus::read_block(VirtualAddress src, void* dst, Word size)
+{
+    if (!check_block(src, size, PageRead))
+        return false;
+
+    std::memcpy(dst, (void*)get_physical_addr(src), size);
+    return true;
+}
+
+bool Bus::upload_block(VirtualAddress src, void* dst, Word size)
+{
+    if (!check_block(src, size, PageRead))
+        return false;
+
+    HostMemory::copy(dst, (void*)get_physical_addr(src), size);
+    return true;
+}
+
+bool Bus::write_block(VirtualAddress dst, const void* src, Word size)
+{
+    if (!check_block(dst, size, PageWrite))
+        return false;
+
+    std::memcpy((void*)get_physical_addr(dst), src, size);
+    return true;
+}
+
+// IO reads go through the device, so the register map decides what is readable
+template<typename T>
+static FORCE_INLINE T load_at(VirtualAddress addr)
+{
+    if ((addr >> 28) == 1)
+    {
+        if constexpr (std::is_signed_v<T>)
+            return T(IO::read_io<std::make_unsigned_t<T>>(addr));
+        else
+            return IO::read_io<T>(addr);
+    }
+
+    return *reinterpret_cast<T*>(Bus::MAPPED_BUS_ADDRESS_START + addr);
+}
+
 template<typename T>
 static FORCE_INLINE T read_at(VirtualAddress addr)
 {
+#if NGP_MEMORY_PROFILER
+    MemoryProfiler::record(addr, MemoryProfiler::Read);
+#endif // NGP_MEMORY_PROFILER
+
     const Word page_index = Bus::get_page_index(addr);
     if (Bus::page_table[page_index].access & Bus::PageRead) [[likely]]
     {
-        return *reinterpret_cast<T*>(Bus::MAPPED_BUS_ADDRESS_START + addr);
+        return load_at<T>(addr);
+    }
+
+    if (Bus::page_table[page_index].access & Bus::PageWatchRead)
+    {
+        Bus::hit_watchpoints(addr, sizeof(T), Bus::PageRead);
+        return load_at<T>(addr);
     }
 
     Bus::invalid_read(addr);
@@ -150,17 +404,33 @@ i8 Bus::read_ibyte(VirtualAddress addr)
     return read_at<i8>(addr);
 }
 
+template<typename T>
+static FORCE_INLINE void store_at(VirtualAddress addr, T value)
+{
+    if ((addr >> 28) == 1)
+        IO::write_io<T>(addr, value);
+    else
+        *reinterpret_cast<T*>(Bus::MAPPED_BUS_ADDRESS_START + addr) = value;
+}
+
 template<typename T>
 inline void write_at(VirtualAddress addr, T value)
 {
+#if NGP_MEMORY_PROFILER
+    MemoryProfiler::record(addr, MemoryProfiler::Write);
+#endif // NGP_MEMORY_PROFILER
+
     VirtualAddress page_index = Bus::get_page_index(addr);
     if (Bus::page_table[page_index].access & Bus::PageWrite) [[likely]]
     {
-        if ((addr >> 28) == 1)
-            IO::write_io<T>(addr, value);
-        else
-            *reinterpret_cast<T*>(Bus::MAPPED_BUS_ADDRESS_START + addr) = value;
+        store_at<T>(addr, value);
+        return;
+    }
 
+    if (Bus::page_table[page_index].access & Bus::PageWatchWrite)
+    {
+        Bus::hit_watchpoints(addr, sizeof(T), Bus::PageWrite);
+        store_at<T>(addr, value);
         return;
     }
  
@@ -191,3 +461,64 @@ void Bus::write_byte(VirtualAddress addr, u8 byte)
 {
     write_at<u8>(addr, byte);
 }
+
+static FORCE_INLINE bool check_atomic_access(VirtualAddress addr, Bus::PageAccess access)
+{
+#if NGP_MEMORY_PROFILER
+    MemoryProfiler::record(addr, MemoryProfiler::Read);
+    if (access & Bus::PageWrite)
+        MemoryProfiler::record(addr, MemoryProfiler::Write);
+#endif // NGP_MEMORY_PROFILER
+
+    if (addr & 0x3)
+    {
+        Bus::invalid_alignment(addr);
+        return false;
+    }
+
+    const Bus::Page& page = Bus::get_page(addr);
+    if ((Bus::get_page_access(page) & access) == access && (addr >> 28) != 1) [[likely]]
+    {
+        if (page.access & (access << 3)) [[unlikely]]
+            Bus::hit_watchpoints(addr, sizeof(Word), access);
+
+        return true;
+    }
+
+    if (access & Bus::PageWrite)
+        Bus::invalid_write(addr);
+    else
+        Bus::invalid_read(addr);
+
+    return false;
+}
+
+static FORCE_INLINE std::atomic_ref<Word> atomic_word_at(VirtualAddress addr)
+{
+    return std::atomic_ref<Word>(*reinterpret_cast<Word*>(Bus::MAPPED_BUS_ADDRESS_START + addr));
+}
+
+bool Bus::atomic_load_word(VirtualAddress addr, Word& value)
+{
+    if (!check_atomic_access(addr, PageRead))
+        return false;
+
+    value = atomic_word_at(addr).load(std::memory_order_acquire);
+    return true;
+}
+
+Word Bus::atomic_swap_word(VirtualAddress addr, Word word)
+{
+    if (!check_atomic_access(addr, PageAccess(PageRead | PageWrite)))
+        return 0;
+
+    return atomic_word_at(addr).exchange(word, std::memory_order_acq_rel);
+}
+
+bool Bus::atomic_compare_exchange_word(VirtualAddress addr, Word& expected, Word desired)
+{
+    if (!check_atomic_access(addr, PageAccess(PageRead | PageWrite)))
+        return false;
+
+    return atomic_word_at(addr).compare_exchange_strong(expected, desired, std::memory_order_acq_rel);
+}
@@ -6,6 +6,7 @@
 /******************************************************/
 #pragma once
 #include "Core/Header.h"
+#include <mutex>
 #include <vector>
 
 struct Bus
@@ -53,6 +54,19 @@ struct Bus
         PageRead = 0x1,
         PageWrite = 0x2,
         PageExecute = 0x4,
+
+        // A watched page has its PageRead/PageWrite bit moved here, so the
+        // fast path fails on it and the access is routed to the watch check.
+        PageWatchRead = PageRead << 3,
+        PageWatchWrite = PageWrite << 3,
+    };
+
+    struct Watchpoint
+    {
+        VirtualAddress address;
+        Word size;
+        // PageRead and/or PageWrite
+        PageAccess access;
     };
 
     struct Page
@@ -71,6 +85,12 @@ struct Bus
     static inline PhysicalAddress io;
     static inline PhysicalAddress ram;
 
+    // True when the BIOS pages are a copy-on-write view of the BIOS file
+    static inline bool bios_file_mapped = false;
+
+    static inline std::vector<Watchpoint> watchpoints;
+    static inline std::mutex watch_mutex;
+
     static void initialize();
     static void shutdown();
 
@@ -89,23 +109,38 @@ struct Bus
         return addr & PageMask;
     }
 
+    // Access of the page as seen by the guest, watched pages are still accessible
+    static FORCE_INLINE Word get_page_access(const Page& page)
+    {
+        return page.access | ((page.access >> 3) & (PageRead | PageWrite));
+    }
+
     static PhysicalAddress bios_start_address() { return PhysicalAddress(bios); }
     static PhysicalAddress ram_start_address() { return PhysicalAddress(ram); }
     static PhysicalAddress io_start_address() { return PhysicalAddress(io); }
 
     static void invalid_read(VirtualAddress addr);
     static void invalid_write(VirtualAddress addr);
+    static void invalid_alignment(VirtualAddress addr);
 
-    static bool load_bios(const char* path);
+    static bool load_bios(const char* path, bool map_file);
+
+    // Watchpoints can be added before initialize, the pages are marked once the
+    // page table exists. Only accesses to watched pages leave the fast path.
+    static bool add_watchpoint(VirtualAddress address, Word size, PageAccess access);
+    static void remove_watchpoint(VirtualAddress address, Word size);
+    static void clear_watchpoints();
+    static void update_watch_pages(Word first_page, Word last_page);
+    static void hit_watchpoints(VirtualAddress address, Word size, PageAccess access);
 
     static FORCE_INLINE CheckAddressResult check_virtual_address(VirtualAddress va, CheckAddressFlags flags)
     {
         VirtualAddress page_index = va >> PageBits;
-        Page& page = page_table[page_index];
-        if(flags & WriteableAddress && !(page.access & PageWrite))
+        const Word access = get_page_access(page_table[page_index]);
+        if(flags & WriteableAddress && !(access & PageWrite))
             return InvalidAddress;
     
-        if (flags & ReadeableAddress && !(page.access & PageRead))
+        if (flags & ReadeableAddress && !(access & PageRead))
             return InvalidAddress;
     
         return ValidAddress;
@@ -116,6 +151,21 @@ struct Bus
         return MAPPED_BUS_ADDRESS_START + PhysicalAddress(pc);
     }
 
+    // Block operations validate the access once per page span and then move the data
+    // with host memcpy/memset. If any page of a range lacks the access (or is an IO page
+    // and the range is written) they return false without touching memory.
+    static bool check_range(VirtualAddress va, Word size, PageAccess access);
+    // Like check_range, and reports the range to the watchpoints and the memory
+    // profiler, for devices that move guest memory themselves
+    static bool check_block(VirtualAddress va, Word size, PageAccess access);
+    static bool copy_range(VirtualAddress dst, VirtualAddress src, Word size);
+    static bool fill_range(VirtualAddress dst, u8 value, Word size);
+    static bool fill_range_word(VirtualAddress dst, Word pattern, Word size);
+    static bool read_block(VirtualAddress src, void* dst, Word size);
+    static bool write_block(VirtualAddress dst, const void* src, Word size);
+    // Like read_block but large copies bypass the host cache, for device memory uploads
+    static bool upload_block(VirtualAddress src, void* dst, Word size);
+
     static QWord read_qword(VirtualAddress addr);
     static DWord read_dword(VirtualAddress addr);
     static Word read_word(VirtualAddress addr);
@@ -130,4 +180,11 @@ struct Bus
     static void write_half(VirtualAddress addr, u16 half);
     static void write_byte(VirtualAddress addr, u8 byte);
 
+    // Word atomics done in place on the fixed host mapping, so every core sees
+    // them as a single access. The address must be word aligned and not MMIO.
+    // False when the access faulted, value is left untouched
+    static bool atomic_load_word(VirtualAddress addr, Word& value);
+    static Word atomic_swap_word(VirtualAddress addr, Word word);
+    static bool atomic_compare_exchange_word(VirtualAddress addr, Word& expected, Word desired);
+
 };
\ No newline at end of file
@@ -0,0 +1,157 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#include "Memory/MemoryProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Counter blocks outlive their threads so the counts of finished threads are kept
+static std::vector<std::unique_ptr<MemoryProfiler::Counters>> thread_counters;
+static std::mutex counters_mutex;
+
+struct RegionInfo
+{
+    const char* name;
+    Word first_slot;
+    Word slot_count;
+    VirtualAddress base_address;
+    Word slot_size;
+};
+
+static constexpr RegionInfo regions[] =
+{
+    { "bios", MemoryProfiler::BIOSSlotStart, MemoryProfiler::BIOSSlots, Bus::BIOS_START, Bus::PageSize },
+    { "io", MemoryProfiler::IOSlotStart, MemoryProfiler::IOSlots, IO::IO_BASE, IO::SegmentSize },
+    { "ram", MemoryProfiler::RAMSlotStart, MemoryProfiler::RAMSlots, Bus::RAM_START, Bus::PageSize },
+    { "vram", MemoryProfiler::VRAMSlotStart, MemoryProfiler::VRAMSlots, 0, Bus::PageSize },
+};
+
+static constexpr const char* kind_names[MemoryProfiler::KindCount] = { "reads", "writes", "executes" };
+
+MemoryProfiler::Counters& MemoryProfiler::register_thread()
+{
+    auto counters = std::make_unique<Counters>();
+    std::memset(counters.get(), 0, sizeof(Counters));
+    local_counters = counters.get();
+
+    std::lock_guard lock{ counters_mutex };
+    thread_counters.emplace_back(std::move(counters));
+    return *local_counters;
+}
+
+void MemoryProfiler::record_range(VirtualAddress addr, Word size, AccessKind kind)
+{
+    if (size == 0)
+        return;
+
+    const Word first_page = Bus::get_page_index(addr);
+    const Word last_page = Bus::get_page_index(addr + size - 1);
+    for (Word page = first_page; page <= last_page; page++)
+    {
+        record(page << Bus::PageBits, kind);
+    }
+}
+
+void MemoryProfiler::record_vram(Word offset, Word size, AccessKind kind)
+{
+    if (size == 0 || offset >= Bus::VRAM_SIZE)
+        return;
+
+    Counters& counters = local_counters ? *local_counters : register_thread();
+
+    const Word first_page = offset >> Bus::PageBits;
+    const Word last_page = (std::min(u64(offset) + size, u64(Bus::VRAM_SIZE)) - 1) >> Bus::PageBits;
+    for (Word page = first_page; page <= last_page; page++)
+    {
+        increment(counters.count[VRAMSlotStart + page][kind]);
+    }
+}
+
+static bool ends_with(const char* str, const char* suffix)
+{
+    const usize len = std::strlen(str);
+    const usize suffix_len = std::strlen(suffix);
+    return len >= suffix_len && std::strcmp(str + len - suffix_len, suffix) == 0;
+}
+
+bool MemoryProfiler::dump(const char* path)
+{
+    // Counting threads may keep running, the snapshot may be a few accesses behind
+    auto merged = std::make_unique<Counters>();
+    std::memset(merged.get(), 0, sizeof(Counters));
+    {
+        std::lock_guard lock{ counters_mutex };
+        for (const auto& counters : thread_counters)
+        {
+            for (Word slot = 0; slot < SlotCount; slot++)
+            {
+                for (Word kind = 0; kind < KindCount; kind++)
+                {
+                    merged->count[slot][kind] += std::atomic_ref<u64>(counters->count[slot][kind]).load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    FILE* file = std::fopen(path, "w");
+    if (!file)
+    {
+        printf("error: cannot open memory profile '%s'\n", path);
+        return false;
+    }
+
+    if (ends_with(path, ".csv"))
+    {
+        std::fprintf(file, "region,address,size,reads,writes,executes\n");
+        for (const RegionInfo& region : regions)
+        {
+            for (Word i = 0; i < region.slot_count; i++)
+            {
+                const u64* count = merged->count[region.first_slot + i];
+                std::fprintf(
+                    file, "%s,0x%08X,%u,%llu,%llu,%llu\n",
+                    region.name, region.base_address + i * region.slot_size, region.slot_size,
+                    count[Read], count[Write], count[Execute]
+                );
+            }
+        }
+    }
+    else
+    {
+        // Every region is a heat map, one array entry per slot
+        std::fprintf(file, "{\n");
+        for (usize r = 0; r < std::size(regions); r++)
+        {
+            const RegionInfo& region = regions[r];
+            std::fprintf(
+                file, "  \"%s\": {\n    \"base\": %u,\n    \"slot_size\": %u,\n",
+                region.name, region.base_address, region.slot_size
+            );
+
+            for (Word kind = 0; kind < KindCount; kind++)
+            {
+                std::fprintf(file, "    \"%s\": [", kind_names[kind]);
+                for (Word i = 0; i < region.slot_count; i++)
+                {
+                    std::fprintf(file, i ? ",%llu" : "%llu", merged->count[region.first_slot + i][kind]);
+                }
+                std::fprintf(file, kind + 1 < KindCount ? "],\n" : "]\n");
+            }
+
+            std::fprintf(file, r + 1 < std::size(regions) ? "  },\n" : "  }\n");
+        }
+        std::fprintf(file, "}\n");
+    }
+
+    std::fclose(file);
+    return true;
+}
@@ -0,0 +1,102 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#pragma once
+#include "Core/Header.h"
+#include "IO/IO.h"
+#include "Memory/Bus.h"
+
+#include <atomic>
+
+// Enabled with the NGP_MEMORY_PROFILER CMake option, when disabled every hook
+// in the bus compiles to nothing.
+#ifndef NGP_MEMORY_PROFILER
+#define NGP_MEMORY_PROFILER 0
+#endif // NGP_MEMORY_PROFILER
+
+struct MemoryProfiler
+{
+    enum AccessKind
+    {
+        Read = 0,
+        Write,
+        Execute,
+        KindCount,
+    };
+
+    // One slot per 16 KB page of BIOS, RAM and VRAM and one per IO segment,
+    // the last IO slot collects the segments without a device.
+    static constexpr Word BIOSSlots = Bus::BIOS_SIZE >> Bus::PageBits;
+    static constexpr Word IOSlots = Word(IO::LAST_SEGMENT) + 1;
+    static constexpr Word RAMSlots = Bus::RAM_SIZE >> Bus::PageBits;
+    static constexpr Word VRAMSlots = Bus::VRAM_SIZE >> Bus::PageBits;
+
+    static constexpr Word BIOSSlotStart = 0;
+    static constexpr Word IOSlotStart = BIOSSlotStart + BIOSSlots;
+    static constexpr Word RAMSlotStart = IOSlotStart + IOSlots;
+    static constexpr Word VRAMSlotStart = RAMSlotStart + RAMSlots;
+    static constexpr Word SlotCount = VRAMSlotStart + VRAMSlots;
+
+    struct Counters
+    {
+        u64 count[SlotCount][KindCount];
+    };
+
+    // Every thread counts into its own block, the blocks are merged on dump.
+    // Only the owner writes a block, relaxed accesses keep dumps of running threads defined
+    static inline thread_local Counters* local_counters = nullptr;
+
+    // Written at shutdown when set
+    static inline const char* dump_path = nullptr;
+    static constexpr const char* DefaultDumpPath = "memory_profile.json";
+    // Set by the dump hotkey or signal, the main loop does the dump
+    static inline std::atomic<bool> dump_requested = false;
+
+    static Counters& register_thread();
+
+    static FORCE_INLINE Word get_slot(VirtualAddress addr)
+    {
+        if (addr <= Bus::BIOS_END)
+            return BIOSSlotStart + (addr >> Bus::PageBits);
+
+        if ((addr >> 28) == 1)
+        {
+            const Word segment = (addr - IO::IO_BASE) >> IO::SegmentBits;
+            return IOSlotStart + (segment < Word(IO::LAST_SEGMENT) ? segment : Word(IO::LAST_SEGMENT));
+        }
+
+        if (addr - Bus::RAM_START < Bus::RAM_SIZE)
+            return RAMSlotStart + ((addr - Bus::RAM_START) >> Bus::PageBits);
+
+        return SlotCount;
+    }
+
+    static FORCE_INLINE void record(VirtualAddress addr, AccessKind kind)
+    {
+        const Word slot = get_slot(addr);
+        if (slot >= SlotCount)
+            return;
+
+        Counters& counters = local_counters ? *local_counters : register_thread();
+        increment(counters.count[slot][kind]);
+    }
+
+    static FORCE_INLINE void increment(u64& count)
+    {
+        std::atomic_ref<u64> counter(count);
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Safe from a signal handler
+    static void request_dump() { dump_requested.store(true, std::memory_order_relaxed); }
+
+    // Block transfers count once per page they touch
+    static void record_range(VirtualAddress addr, Word size, AccessKind kind);
+    static void record_vram(Word offset, Word size, AccessKind kind);
+
+    // The format is picked by the extension, .csv or JSON otherwise
+    static bool dump(const char* path);
+};
@@ -6,7 +6,10 @@
 /******************************************************/
 #include "Platform/OS.h"
 
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 static inline i32 get_protection(OS::PageAccess access)
@@ -52,6 +55,109 @@ void OS::deallocate_virtual_memory(void* address)
     munmap(address, 0);
 }
 
+void* OS::map_file(void* address, const char* path, usize size, PageAccess access)
+{
+    i32 fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+
+    // MAP_FIXED replaces any mapping that lives at the requested address
+    i32 flags = MAP_PRIVATE | (address ? MAP_FIXED : 0);
+    void* mapped = mmap64(address, size, get_protection(access), flags, fd, 0);
+    close(fd);
+
+    return mapped == MAP_FAILED ? nullptr : mapped;
+}
+
+void OS::unmap_file(void* address, usize size)
+{
+    munmap(address, size);
+}
+
+void OS::advise_memory(void* address, usize size, MemoryAdvice advice)
+{
+    // madvise wants a page aligned start
+    const usize page_size = usize(sysconf(_SC_PAGESIZE));
+    const usize start = usize(address) & ~(page_size - 1);
+    size += usize(address) - start;
+
+    switch (advice)
+    {
+    case ADVICE_NORMAL:
+        madvise((void*)start, size, MADV_NORMAL);
+        break;
+    case ADVICE_SEQUENTIAL:
+        madvise((void*)start, size, MADV_SEQUENTIAL);
+        break;
+    case ADVICE_RANDOM:
+        madvise((void*)start, size, MADV_RANDOM);
+        break;
+    case ADVICE_WILLNEED:
+        madvise((void*)start, size, MADV_WILLNEED);
+        break;
+    }
+}
+
+OS::FileHandle OS::open_file(const char* path, bool writeable)
+{
+    i32 fd = open(path, writeable ? O_RDWR : O_RDONLY);
+    return fd == -1 ? InvalidFile : FileHandle(fd);
+}
+
+OS::FileHandle OS::create_file(const char* path)
+{
+    i32 fd = open(path, O_RDWR | O_CREAT, 0644);
+    return fd == -1 ? InvalidFile : FileHandle(fd);
+}
+
+void OS::close_file(FileHandle file)
+{
+    close(i32(file));
+}
+
+u64 OS::get_file_size(FileHandle file)
+{
+    struct stat64 info;
+    if (fstat64(i32(file), &info) != 0)
+        return 0;
+
+    return u64(info.st_size);
+}
+
+bool OS::read_file_at(FileHandle file, u64 offset, void* buffer, usize size)
+{
+    u8* out = (u8*)buffer;
+    while (size)
+    {
+        ssize_t result = pread64(i32(file), out, size, off64_t(offset));
+        if (result <= 0)
+            return false;
+
+        out += result;
+        offset += result;
+        size -= result;
+    }
+
+    return true;
+}
+
+bool OS::write_file_at(FileHandle file, u64 offset, const void* buffer, usize size)
+{
+    const u8* in = (const u8*)buffer;
+    while (size)
+    {
+        ssize_t result = pwrite64(i32(file), in, size, off64_t(offset));
+        if (result <= 0)
+            return false;
+
+        in += result;
+        offset += result;
+        size -= result;
+    }
+
+    return true;
+}
+
 u32 OS::exception_handler(void*)
 {
     return 0;
@@ -20,6 +20,18 @@ struct OS
 
     using PageFaultHandler = void(*)(void*);
 
+    enum MemoryAdvice
+    {
+        ADVICE_NORMAL = 0x0,
+        ADVICE_SEQUENTIAL = 0x1,
+        ADVICE_RANDOM = 0x2,
+        ADVICE_WILLNEED = 0x3,
+    };
+
+    // File descriptor on Linux, HANDLE on Win32
+    using FileHandle = isize;
+    static constexpr FileHandle InvalidFile = -1;
+
     static void initialize();
     static void shutdown();
 
@@ -28,5 +40,21 @@ struct OS
     static void* allocate_virtual_memory(void* address, usize size, PageAccess access);
     static void deallocate_virtual_memory(void* address);
 
+    // Maps the first size bytes of a file copy-on-write, pages are shared with
+    // every other process mapping the same file until they are written.
+    static void* map_file(void* address, const char* path, usize size, PageAccess access);
+    static void unmap_file(void* address, usize size);
+    // Paging hint for a mapped range, it never changes the contents
+    static void advise_memory(void* address, usize size, MemoryAdvice advice);
+
+    // Positional file IO, safe to use from several threads on the same file
+    static FileHandle open_file(const char* path, bool writeable);
+    // Opens for read/write, the file is created empty if it doesn't exist
+    static FileHandle create_file(const char* path);
+    static void close_file(FileHandle file);
+    static u64 get_file_size(FileHandle file);
+    static bool read_file_at(FileHandle file, u64 offset, void* buffer, usize size);
+    static bool write_file_at(FileHandle file, u64 offset, const void* buffer, usize size);
+
     static u32 exception_handler(void*);
 };
@@ -54,6 +54,120 @@ void OS::deallocate_virtual_memory(void* address)
     VirtualFree(address, 0, MEM_RELEASE);
 }
 
+void* OS::map_file(void* address, const char* path, usize size, PageAccess access)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    // PAGE_WRITECOPY allows copy-on-write views of a read only file
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return nullptr;
+
+    DWORD view_access = access == PAGE_READ_ONLY ? FILE_MAP_READ : FILE_MAP_COPY;
+    void* view = MapViewOfFileEx(mapping, view_access, 0, 0, size, address);
+    CloseHandle(mapping);
+
+    return view;
+}
+
+void OS::unmap_file(void* address, usize)
+{
+    UnmapViewOfFile(address);
+}
+
+void OS::advise_memory(void* address, usize size, MemoryAdvice advice)
+{
+    // Windows only has a prefetch hint
+    if (advice == ADVICE_WILLNEED)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range = { address, size };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+}
+
+OS::FileHandle OS::open_file(const char* path, bool writeable)
+{
+    DWORD access = writeable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+    HANDLE file = CreateFileA(path, access, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return file == INVALID_HANDLE_VALUE ? InvalidFile : FileHandle(file);
+}
+
+OS::FileHandle OS::create_file(const char* path)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return InvalidFile;
+
+    // Sectors that were never written stay as holes
+    DWORD returned = 0;
+    DeviceIoControl(file, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);
+    return FileHandle(file);
+}
+
+void OS::close_file(FileHandle file)
+{
+    CloseHandle(HANDLE(file));
+}
+
+u64 OS::get_file_size(FileHandle file)
+{
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(HANDLE(file), &size))
+        return 0;
+
+    return u64(size.QuadPart);
+}
+
+// The offset goes in the OVERLAPPED structure, the file position is not shared
+static inline OVERLAPPED get_file_offset(u64 offset)
+{
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = DWORD(offset);
+    overlapped.OffsetHigh = DWORD(offset >> 32);
+    return overlapped;
+}
+
+bool OS::read_file_at(FileHandle file, u64 offset, void* buffer, usize size)
+{
+    u8* out = (u8*)buffer;
+    while (size)
+    {
+        OVERLAPPED overlapped = get_file_offset(offset);
+        DWORD to_read = DWORD(size > 0x8000'0000 ? 0x8000'0000 : size);
+        DWORD read = 0;
+        if (!ReadFile(HANDLE(file), out, to_read, &read, &overlapped) || read == 0)
+            return false;
+
+        out += read;
+        offset += read;
+        size -= read;
+    }
+
+    return true;
+}
+
+bool OS::write_file_at(FileHandle file, u64 offset, const void* buffer, usize size)
+{
+    const u8* in = (const u8*)buffer;
+    while (size)
+    {
+        OVERLAPPED overlapped = get_file_offset(offset);
+        DWORD to_write = DWORD(size > 0x8000'0000 ? 0x8000'0000 : size);
+        DWORD written = 0;
+        if (!WriteFile(HANDLE(file), in, to_write, &written, &overlapped) || written == 0)
+            return false;
+
+        in += written;
+        offset += written;
+        size -= written;
+    }
+
+    return true;
+}
+
 u32 OS::exception_handler(void* ptr)
 {
     EXCEPTION_POINTERS* exception_info = (EXCEPTION_POINTERS*)ptr;
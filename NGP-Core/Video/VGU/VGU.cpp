@@ -6,11 +6,15 @@
 /******************************************************/
 #include "Video/VGU/VGU.h"
 
+#include "Core/HostMemory.h"
 #include "Memory/Bus.h"
+#include "Memory/MemoryProfiler.h"
 #include "IO/DMA/DMA.h"
 #include "IO/GU/GU.h"
+#include "IO/IRQ/IRQ.h"
 #include "Platform/OS.h"
 #include "Video/OpenGL/GLGU.h"
+#include "Video/VGU/VPixelFormat.h"
 #include "Video/VGU/VRasterizer.h"
 
 #if defined(_WIN32)
@@ -22,20 +26,6 @@
 #include <algorithm>
 
 
-#define VGPU_LOGGER(...) { printf("VGPU: "); printf(__VA_ARGS__); putchar('\n'); }
-
-template<typename T>
-static void dma_transfer_with_step(PhysicalAddress dest_mem, PhysicalAddress src_mem, Word len)
-{
-    while (len--)
-    {
-        *((T*)dest_mem) = *((T*)src_mem);
-        dest_mem += sizeof(T);
-        src_mem += sizeof(T);
-    }
-}
-
-
 GUDevice::GUDriver get_internal_driver(GUDevice::DriverApi api)
 {
     switch (api)
@@ -94,6 +84,7 @@ void VGU::initialize()
 
     state.present_requested = false;
     state.irq_pending = false;
+    state.submits.clear();
 
     // Internal driver
     state.internal_driver = get_internal_driver(GUDevice::D3D11);
@@ -105,10 +96,19 @@ void VGU::initialize()
     state.current_fb = -1;
 
     VRasterizer::initialize();
+
+    state.queue_exit = false;
+    state.queue_thread = std::thread(&VGU::queue_worker, state.queue_wake.load(std::memory_order_acquire));
 }
 
 void VGU::shutdown()
 {
+    // Lists already kicked still run
+    state.queue_exit.store(true, std::memory_order_release);
+    state.queue_wake.fetch_add(1, std::memory_order_release);
+    state.queue_wake.notify_one();
+    state.queue_thread.join();
+
     VRasterizer::shutdown();
     VGUQueue::shutdown();
 
@@ -120,14 +120,22 @@ void VGU::shutdown()
 
 bool VGU::present(bool vsync)
 {
-    state.sync_mutex.lock();
-    bool present_requested = state.present_requested;
-    state.sync_mutex.unlock();
+    bool present_requested = state.present_requested.load(std::memory_order_acquire);
 
     if (state.display_address == nullptr || state.current_fb == InvalidFB || !present_requested)
         return false;
 
-    state.internal_driver.update_framebuffer(get_current_framebuffer().framebuffer, state.display_address);
+    const VFramebuffer& fb = get_current_framebuffer();
+    void* pixels = state.display_address;
+    if (fb.display_format != Display::FORMAT_RGBA8)
+    {
+        state.resolve_buffer.resize(usize(fb.width) * fb.height);
+        unpack_pixels(GU::TextureFormat(fb.display_format), (const u8*)state.display_address,
+            state.resolve_buffer.data(), state.resolve_buffer.size());
+        pixels = state.resolve_buffer.data();
+    }
+
+    state.internal_driver.update_framebuffer(fb.framebuffer, pixels);
     state.internal_driver.present_framebuffer(get_current_framebuffer().framebuffer, vsync);
 
     set_present_requested(false);
@@ -178,67 +186,140 @@ void VGU::queue_execute(VirtualAddress cmd_list, Word cmd_len)
     if (cmd_len == 0)
         return;
 
-    state.queue_mutex.lock();
-    VGUQueue::set_state(cmd_list, cmd_len, VGUQueue::get_state());
-    VGUQueue::set_signal(VGUQueue::QUEUE_SIGNAL_RUN);
-    state.queue_mutex.unlock();
+    GU::GURegisters& regs = GU::get_registers();
+    std::atomic_ref<Word> queue_seq(regs.queue_seq);
+    std::atomic_ref<Word> queue_state(regs.queue_state);
+
+    // Any core can kick, the sequence comes from the reserved slot so it
+    // follows the ring order. BUSY is visible before the queue thread can
+    // see the list, a core that lost the race to a newer kick leaves its
+    // registers alone.
+    const bool pushed = state.submits.push_with([&](usize position)
+    {
+        const Word sequence = Word(position + 1);
+
+        Word last_sequence = queue_seq.load(std::memory_order_relaxed);
+        while (GU::sequence_after(sequence, last_sequence) &&
+            !queue_seq.compare_exchange_weak(last_sequence, sequence, std::memory_order_release, std::memory_order_relaxed)) {}
+
+        Word last_state = queue_state.load(std::memory_order_relaxed);
+        while (GU::sequence_after(sequence << 8, last_state & ~GU::QueueStateMask) &&
+            !queue_state.compare_exchange_weak(last_state, GU::make_queue_state(sequence, GU::QUEUE_BUSY), std::memory_order_release, std::memory_order_relaxed)) {}
+
+        return QueueSubmit{ cmd_list, cmd_len, sequence };
+    });
+
+    // The core never waits for the GU, a kick past the ring is dropped
+    if (!pushed)
+    {
+        Word last_state = queue_state.load(std::memory_order_relaxed);
+        while (!queue_state.compare_exchange_weak(last_state, (last_state & ~GU::QueueStateMask) | GU::QUEUE_ERROR_FULL, std::memory_order_release, std::memory_order_relaxed)) {}
+        return;
+    }
+
+    state.queue_wake.fetch_add(1, std::memory_order_release);
+    state.queue_wake.notify_one();
 }
 
 void VGU::queue_dispatch()
 {
-    state.queue_mutex.lock();
-    VGUQueue::try_execute();
-    state.queue_mutex.unlock();
+    // Lists run on the queue thread
 }
 
-void VGU::dma_send(VirtualAddress dest, VirtualAddress src, Word len, Word flags)
+void VGU::queue_worker(u32 seen)
+{
+    while (true)
+    {
+        QueueSubmit submit;
+        if (state.submits.pop(submit))
+        {
+            VGUQueue::set_state(submit.cmd_list, submit.cmd_len, VGUQueue::get_state());
+            VGUQueue::set_signal(VGUQueue::QUEUE_SIGNAL_RUN);
+            VGUQueue::try_execute();
+
+            complete_submit(submit, VGUQueue::get_state());
+            continue;
+        }
+
+        if (state.queue_exit.load(std::memory_order_acquire))
+            return;
+
+        state.queue_wake.wait(seen, std::memory_order_acquire);
+        seen = state.queue_wake.load(std::memory_order_acquire);
+    }
+}
+
+void VGU::complete_submit(const QueueSubmit& submit, GU::QueueState result)
 {
-    PhysicalAddress dest_mem = 0;
-    PhysicalAddress src_mem = 0;
+    GU::GURegisters& regs = GU::get_registers();
+
+    // Fails when a later kick stored its own state, the queue stays busy
+    Word expected = GU::make_queue_state(submit.sequence, GU::QUEUE_BUSY);
+    std::atomic_ref<Word>(regs.queue_state).compare_exchange_strong(expected, GU::make_queue_state(submit.sequence, result), std::memory_order_acq_rel);
+    std::atomic_ref<Word>(regs.queue_fence).store(submit.sequence, std::memory_order_release);
 
-    DMA::DMADirection dir = DMA::DMADirection((flags >> 3) & 0x3);
-    DMA::DMAStep step = DMA::DMAStep((flags >> 5) & 0x7);
+    std::atomic_ref<Word>(regs.irq_status).fetch_or(GU::IRQ_MASK_QUEUE, std::memory_order_release);
+    if (std::atomic_ref<Word>(regs.irq_mask).load(std::memory_order_relaxed) & GU::IRQ_MASK_QUEUE)
+    {
+        IRQ::raise(IRQ::IRQ_MASK_GU);
+    }
+}
 
+void VGU::dma_send(VirtualAddress dest, VirtualAddress src, Word len, Word flags)
+{
+    DMA::DMADirection dir = DMA::get_direction(flags);
+    DMA::DMAStep step = DMA::get_step(flags);
+    const Word bytes = len * DMA::get_step_size(step);
+
+    // Both sides are validated once for the whole transfer, RAM by the bus
     if (dir == DMA::DMA_RAM_TO_DEVICE)
     {
-        dest_mem = VRamAddress + dest;
-        src_mem = Bus::get_physical_addr(src);
+        if (!check_vram_range(dest, bytes))
+        {
+            VGPU_LOGGER("DMA destination range %08X-%08X is out of VRAM", dest, dest + bytes);
+            return;
+        }
+
+        // Uploads are consumed by the rasterizer later, they don't need to stay in cache
+        if (!Bus::upload_block(src, (void*)(VRamAddress + dest), bytes))
+        {
+            VGPU_LOGGER("DMA source range %08X-%08X is not readable", src, src + bytes);
+        }
+#if NGP_MEMORY_PROFILER
+        MemoryProfiler::record_vram(dest, bytes, MemoryProfiler::Write);
+#endif // NGP_MEMORY_PROFILER
     }
     else if (dir == DMA::DMA_DEVICE_TO_RAM)
     {
-        dest_mem = Bus::get_physical_addr(dest);
-        src_mem = VRamAddress + src;
+        if (!check_vram_range(src, bytes))
+        {
+            VGPU_LOGGER("DMA source range %08X-%08X is out of VRAM", src, src + bytes);
+            return;
+        }
+
+        if (!Bus::write_block(dest, (void*)(VRamAddress + src), bytes))
+        {
+            VGPU_LOGGER("DMA destination range %08X-%08X is not writeable", dest, dest + bytes);
+        }
+#if NGP_MEMORY_PROFILER
+        MemoryProfiler::record_vram(src, bytes, MemoryProfiler::Read);
+#endif // NGP_MEMORY_PROFILER
     }
     else if (dir == DMA::DMA_DEVICE_TO_DEVICE)
     {
-        dest_mem = VRamAddress + dest;
-        src_mem = VRamAddress + src;
-    }
-    else
-    {
-        return;
-    }
+        if (!check_vram_range(src, bytes) || !check_vram_range(dest, bytes))
+        {
+            VGPU_LOGGER("DMA VRAM range %08X -> %08X (%u bytes) is out of VRAM", src, dest, bytes);
+            return;
+        }
 
-    switch (step)
-    {
-    case DMA::DMA_WORD:
-        dma_transfer_with_step<Word>(dest_mem, src_mem, len);
-        break;
-    case DMA::DMA_HALF:
-        dma_transfer_with_step<u16>(dest_mem, src_mem, len);
-        break;
-    case DMA::DMA_BYTE:
-        dma_transfer_with_step<u8>(dest_mem, src_mem, len);
-        break;
-    case DMA::DMA_DWORD:
-        dma_transfer_with_step<DWord>(dest_mem, src_mem, len);
-        break;
-    case DMA::DMA_QWORD:
-        dma_transfer_with_step<QWord>(dest_mem, src_mem, len);
-        break;
-    }
+        HostMemory::copy((void*)(VRamAddress + dest), (void*)(VRamAddress + src), bytes);
 
-    DMA::get_registers().channels[DMA::DMA_CHANNEL_GU].ctr = flags & DMA::DMA_IRQ;
+#if NGP_MEMORY_PROFILER
+        MemoryProfiler::record_vram(src, bytes, MemoryProfiler::Read);
+        MemoryProfiler::record_vram(dest, bytes, MemoryProfiler::Write);
+#endif // NGP_MEMORY_PROFILER
+    }
 }
 
 Bus::CheckAddressResult VGU::check_vram_address(VirtualAddress vva)
@@ -246,6 +327,11 @@ Bus::CheckAddressResult VGU::check_vram_address(VirtualAddress vva)
     return vva < state.vram_size ? Bus::ValidAddress : Bus::InvalidAddress;
 }
 
+bool VGU::check_vram_range(VirtualAddress vva, Word size)
+{
+    return u64(vva) + size <= state.vram_size;
+}
+
 // Implementation
 
 PhysicalAddress VGU::get_physical_vram_address(VirtualAddress vaddress)
@@ -256,9 +342,7 @@ PhysicalAddress VGU::get_physical_vram_address(VirtualAddress vaddress)
 // Internal functions
 void VGU::set_present_requested(bool requested)
 {
-    state.sync_mutex.lock();
-    state.present_requested = requested;
-    state.sync_mutex.unlock();
+    state.present_requested.store(requested, std::memory_order_release);
 }
 
 
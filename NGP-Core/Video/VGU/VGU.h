@@ -6,11 +6,16 @@
 /******************************************************/
 #pragma once
 #include "Core/JobQueue.h"
+#include "Core/RingBuffer.h"
 #include "Video/VGU/VGUQueue.h"
 
-#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <thread>
 #include <vector>
 
+#define VGPU_LOGGER(...) { printf("VGPU: "); printf(__VA_ARGS__); putchar('\n'); }
+
 
 struct VGU
 {
@@ -30,6 +35,16 @@ struct VGU
         u8 mag_filter;
     };
 
+    // A command list kicked by the core, executed by the queue thread
+    struct QueueSubmit
+    {
+        VirtualAddress cmd_list;
+        Word cmd_len;
+        Word sequence;
+    };
+
+    static constexpr usize MaxQueueSubmits = 64;
+
     struct VFramebuffer
     {
         i32 width;
@@ -45,15 +60,21 @@ struct VGU
         Word vram_size;
         Word* vram;
         Word* display_address;
+        // RGBA8 copy of a display in another format, handed to the driver
+        std::vector<Word> resolve_buffer;
 
         std::vector<VFramebuffer> cached_framebuffers;
         i32 current_fb;
 
         TMU texture_units[16];
-        std::mutex sync_mutex;
-        std::mutex queue_mutex;
+        RingBuffer<QueueSubmit, MaxQueueSubmits> submits;
+
+        std::thread queue_thread;
+        // Bumped after every push, the queue thread sleeps on it
+        std::atomic<u32> queue_wake;
+        std::atomic<bool> queue_exit;
 
-        bool present_requested;
+        std::atomic<bool> present_requested;
         bool irq_pending;
     };
 
@@ -78,10 +99,13 @@ struct VGU
 
     static void queue_execute(VirtualAddress cmd_list, Word cmd_len);
     static void queue_dispatch();
+    static void queue_worker(u32 seen);
+    static void complete_submit(const QueueSubmit& submit, GU::QueueState result);
 
     static void dma_send(VirtualAddress dest, VirtualAddress src, Word len, Word flags);
 
     static Bus::CheckAddressResult check_vram_address(VirtualAddress vva);
+    static bool check_vram_range(VirtualAddress vva, Word size);
 
     // Internal functions
     static PhysicalAddress get_physical_vram_address(VirtualAddress vaddress);
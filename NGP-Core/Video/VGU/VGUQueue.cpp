@@ -7,48 +7,77 @@
 #include "Video/VGU/VGUQueue.h"
 
 #include "Video/VGU/VGU.h"
+#include "Video/VGU/VPixelFormat.h"
 #include "Video/VGU/VRasterizer.h"
 
-static constexpr Word MinimumWordsPerCommand[256] =
+#include <algorithm>
+#include <array>
+
+static constexpr Word UnknownCommand = 0xFFFF'FFFF;
+
+// Argument words after the command word, UnknownCommand for unused IDs
+static consteval std::array<Word, 256> make_command_words()
 {
-    0, // CMD_END
-    2, // CMD_DRAW_BUFFER
-    1, // CMD_TEXTURE_SET
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    2, // CMD_RECT
-    2, // CMD_FILL_RECT
-    3, // CMD_TRIANGLE
-    3, // CMD_FILL_TRIANGLE
+    std::array<Word, 256> words = {};
+    words.fill(UnknownCommand);
+
+    words[GU::CMD_END] = 0;
+    words[GU::CMD_DRAW_BUFFER] = 2;
+    words[GU::CMD_TEXTURE_SET] = 1;
+    words[GU::CMD_CLEAR] = 0;
+    words[GU::CMD_TEXTURE_FILTER] = 0;
+    words[GU::CMD_BLEND_STATE] = 1;
+    words[GU::CMD_VERTEX_BUFFER] = 1;
+    words[GU::CMD_INDEX_BUFFER] = 1;
+    words[GU::CMD_JUMP] = 2;
+    words[GU::CMD_CALL] = 2;
+    words[GU::CMD_RETURN] = 0;
+    words[GU::CMD_JUMP_IF] = 2;
+    words[GU::CMD_RECT] = 2;
+    words[GU::CMD_FILL_RECT] = 2;
+    words[GU::CMD_TRIANGLE] = 3;
+    words[GU::CMD_FILL_TRIANGLE] = 3;
+    words[GU::CMD_TEXTURED_TRIANGLE] = 6;
+    words[GU::CMD_SPRITE] = 4;
+    words[GU::CMD_DRAW] = 2;
+    words[GU::CMD_DRAW_INDEXED] = 2;
+
+    return words;
+}
+
+static constexpr std::array<Word, 256> CommandWords = make_command_words();
+
+// Nested CMD_CALL
+static constexpr u32 MaxCallDepth = 8;
+// Branches followed in one submit, a list that loops forever hits it
+static constexpr Word MaxBranches = 1 << 16;
+// Words flattened from one submit (16 MB) unless its own list is longer,
+// a short loop taken many times can't grow the stream past it
+static constexpr Word MaxStreamWords = 1 << 22;
+
+// A list being walked by validate
+struct ListFrame
+{
+    const Word* words;
+    Word len;
+    Word index;
 };
 
+static bool map_list(VirtualAddress cmd_list, Word cmd_len, ListFrame& frame)
+{
+    if ((cmd_list & 3) || cmd_len > 0xFFFF'FFFF / sizeof(Word) ||
+        !Bus::check_range(cmd_list, cmd_len * sizeof(Word), Bus::PageRead))
+    {
+        VGPU_LOGGER("Command list %08X-%08X is out of RAM", cmd_list, cmd_list + cmd_len * Word(sizeof(Word)));
+        return false;
+    }
+
+    frame.words = (const Word*)Bus::get_physical_addr(cmd_list);
+    frame.len = cmd_len;
+    frame.index = 0;
+    return true;
+}
+
 void VGUQueue::initialize()
 {
     state.cmd_list = VirtualAddress(0);
@@ -60,15 +89,173 @@ void VGUQueue::shutdown()
 
 }
 
-
 void VGUQueue::try_execute()
 {
     if (state.signal == QUEUE_SIGNAL_IDLE)
         return;
 
-    Word* cmd_words = (Word*)Bus::get_physical_addr(state.cmd_list);
-    Word cmd_len = state.cmd_len;
+    // A malformed list is rejected as a whole, nothing of it runs. The result
+    // reaches GU_QUEUE_STATE when the list completes
+    state.queue_state = validate(state.cmd_list, state.cmd_len, state.stream);
+    if (state.queue_state == GU::QUEUE_FREE)
+    {
+        execute(state.stream.data(), state.stream.size());
+    }
+
+    VRasterizer::reset_state();
+
+    state.cmd_list = 0;
+    state.cmd_len = 0;
+    state.signal = QUEUE_SIGNAL_IDLE;
+}
+
+// Arguments that would make the execution touch memory out of VRAM
+static bool check_arguments(GU::Command cmd, const Word* words)
+{
+    switch (cmd)
+    {
+    case GU::CMD_DRAW_BUFFER:
+    case GU::CMD_TEXTURE_SET:
+    {
+        const VirtualAddress address = (words[0] & 0xFF'FFFF) << 8;
+        const Word width = words[1] & 0xFFF;
+        const Word height = (words[1] >> 12) & 0xFFF;
+        const Word format = cmd == GU::CMD_DRAW_BUFFER ? words[1] >> 24 : (words[1] >> 24) & 0xF;
+        if (format >= GU::TEXTURE_FORMAT_COUNT)
+            return false;
+
+        return VGU::check_vram_range(address, width * height * TexelSize[format]);
+    }
+    case GU::CMD_VERTEX_BUFFER:
+    {
+        const Word format = words[1] >> 28;
+        if (format >= GU::VERTEX_FORMAT_COUNT)
+            return false;
+
+        const Word size = (words[1] & 0x0FFF'FFFF) * VRasterizer::VertexWords[format] * Word(sizeof(Word));
+        return VGU::check_vram_range((words[0] & 0xFF'FFFF) << 8, size);
+    }
+    case GU::CMD_INDEX_BUFFER:
+        return VGU::check_vram_range((words[0] & 0xFF'FFFF) << 8, (words[1] & 0xFF'FFFF) * Word(sizeof(u16)));
+    case GU::CMD_DRAW:
+    case GU::CMD_DRAW_INDEXED:
+        return (words[0] & 0xF) < GU::TOPOLOGY_COUNT;
+    case GU::CMD_BLEND_STATE:
+        return (words[0] & 0xF) < GU::BLEND_FACTOR_COUNT && ((words[0] >> 4) & 0xF) < GU::BLEND_FACTOR_COUNT &&
+            ((words[0] >> 8) & 0xF) < GU::ALPHA_TEST_COUNT;
+    default:
+        return true;
+    }
+}
+
+GU::QueueState VGUQueue::validate(VirtualAddress cmd_list, Word cmd_len, std::vector<Word>& stream)
+{
+    stream.clear();
+
+    if (cmd_len > 0xFFFF'FFFF / sizeof(Word))
+        return GU::QUEUE_ERROR_BAD_LEN;
+
+    // Branches are resolved here, stream never has one
+    ListFrame stack[MaxCallDepth + 1];
+    u32 depth = 0;
+    if (!map_list(cmd_list, cmd_len, stack[0]))
+        return GU::QUEUE_ERROR_BAD_ADDRESS;
+
+    const Word flags = std::atomic_ref<Word>(GU::get_registers().queue_flags).load(std::memory_order_acquire);
+    const usize max_stream = std::max<usize>(cmd_len, MaxStreamWords);
+    Word branches = 0;
+    while (true)
+    {
+        ListFrame& frame = stack[depth];
+        // The end of a called list returns from it
+        if (frame.index >= frame.len)
+        {
+            if (depth == 0)
+                break;
+
+            depth--;
+            continue;
+        }
+
+        const Word* words = frame.words + frame.index;
+        const GU::Command cmd = GU::Command(words[0] >> 24);
+        if (cmd == GU::CMD_END)
+            break;
+
+        const Word arg_words = CommandWords[cmd];
+        if (arg_words == UnknownCommand)
+        {
+            VGPU_LOGGER("Unknown command %02X at word %u", cmd, frame.index);
+            return GU::QUEUE_ERROR_BAD_COMMAND;
+        }
+
+        if (frame.len - frame.index - 1 < arg_words)
+        {
+            VGPU_LOGGER("Command %02X at word %u is cut by the end of the list", cmd, frame.index);
+            return GU::QUEUE_ERROR_BAD_LEN;
+        }
+
+        frame.index += 1 + arg_words;
+
+        switch (cmd)
+        {
+        case GU::CMD_RETURN:
+            if (depth == 0)
+                return GU::QUEUE_FREE;
+
+            depth--;
+            break;
+        case GU::CMD_JUMP:
+        case GU::CMD_CALL:
+        case GU::CMD_JUMP_IF:
+        {
+            if (cmd == GU::CMD_JUMP_IF && !(flags & words[0] & 0xFF'FFFF))
+                break;
+
+            if (++branches > MaxBranches)
+            {
+                VGPU_LOGGER("Command list takes more than %u branches", MaxBranches);
+                return GU::QUEUE_ERROR_BAD_BRANCH;
+            }
+
+            if (cmd == GU::CMD_CALL)
+            {
+                if (depth == MaxCallDepth)
+                {
+                    VGPU_LOGGER("Calls nested deeper than %u", MaxCallDepth);
+                    return GU::QUEUE_ERROR_BAD_BRANCH;
+                }
+
+                depth++;
+            }
+
+            if (!map_list(words[1], words[2], stack[depth]))
+                return GU::QUEUE_ERROR_BAD_ADDRESS;
+            break;
+        }
+        default:
+            if (!check_arguments(cmd, words))
+            {
+                VGPU_LOGGER("Command %02X at word %u has invalid arguments", cmd, frame.index - 1 - arg_words);
+                return GU::QUEUE_ERROR_BAD_ARGUMENT;
+            }
+
+            if (stream.size() + 1 + arg_words > max_stream)
+            {
+                VGPU_LOGGER("Command list expands to more than %llu words", max_stream);
+                return GU::QUEUE_ERROR_BAD_BRANCH;
+            }
+
+            stream.insert(stream.end(), words, words + 1 + arg_words);
+            break;
+        }
+    }
+
+    return GU::QUEUE_FREE;
+}
 
+void VGUQueue::execute(const Word* cmd_words, usize cmd_len)
+{
     while (cmd_len)
     {
         Word cmd_w = cmd_words[0];
@@ -77,17 +264,8 @@ void VGUQueue::try_execute()
 
         GU::Command cmd = GU::Command(cmd_w >> 24);
 
-        if (cmd_len < MinimumWordsPerCommand[cmd])
-        {
-            state.queue_state = GU::QUEUE_ERROR_BAD_LEN;
-            return;
-        }
-
         switch (cmd)
         {
-        case GU::CMD_END:
-            cmd_len = 0;
-            break;
         case GU::CMD_DRAW_BUFFER:
         {
             VirtualAddress db_address = cmd_w & 0xFF'FFFF;
@@ -103,7 +281,7 @@ void VGUQueue::try_execute()
             u16 h = (cmd_w >> 12) & 0xFFF;
             GU::TextureFormat db_format = GU::TextureFormat(cmd_w >> 24);
 
-            cmd_w = cmd_words[1];
+            cmd_w = cmd_words[0];
             cmd_words++;
             cmd_len--;
 
@@ -135,12 +313,70 @@ void VGUQueue::try_execute()
             texture_unit.texture_format = tex_fmt;
         }
         break;
-        case GU::CMD_RECT:
+        case GU::CMD_TEXTURE_FILTER:
+        {
+            VGU::TMU& texture_unit = VGU::get_state().texture_units[cmd_w & 0xF];
+            texture_unit.mag_filter = (cmd_w >> 4) & 0xF;
+            texture_unit.min_filter = (cmd_w >> 8) & 0xF;
+        }
+        break;
+        case GU::CMD_BLEND_STATE:
+        {
+            VRasterizer::BlendState blend = {};
+            blend.src_factor = GU::BlendFactor(cmd_w & 0xF);
+            blend.dst_factor = GU::BlendFactor((cmd_w >> 4) & 0xF);
+            blend.alpha_test = GU::AlphaTest((cmd_w >> 8) & 0xF);
+            blend.write_mask = (cmd_w >> 12) & 0xF;
+            blend.alpha_reference = (cmd_w >> 16) & 0xFF;
+
+            cmd_w = cmd_words[0];
+            cmd_words++;
+            cmd_len--;
+
+            blend.color_alpha = cmd_w & 0xFF;
+
+            VRasterizer::set_blend_state(blend);
+        }
+        break;
+        case GU::CMD_VERTEX_BUFFER:
+        {
+            VirtualAddress vb_address = cmd_w & 0xFF'FFFF;
+            vb_address <<= 8;
+
+            cmd_w = cmd_words[0];
+            cmd_words++;
+            cmd_len--;
+
+            VRasterizer::set_vertex_buffer(VGU::get_physical_vram_address(vb_address), cmd_w & 0x0FFF'FFFF, GU::VertexFormat(cmd_w >> 28));
+        }
+        break;
+        case GU::CMD_INDEX_BUFFER:
+        {
+            VirtualAddress ib_address = cmd_w & 0xFF'FFFF;
+            ib_address <<= 8;
+
+            cmd_w = cmd_words[0];
+            cmd_words++;
+            cmd_len--;
+
+            VRasterizer::set_index_buffer(VGU::get_physical_vram_address(ib_address), cmd_w & 0xFF'FFFF);
+        }
+        break;
+        case GU::CMD_CLEAR:
         {
             Color rgb = {};
             rgb.rgba = cmd_w & 0xFF'FFFF;
             rgb.a = 0xFF;
 
+            VRasterizer::clear(rgb);
+        }
+        break;
+        case GU::CMD_RECT:
+        {
+            Color rgb = {};
+            rgb.rgba = cmd_w & 0xFF'FFFF;
+            rgb.a = VRasterizer::get_state().blend.color_alpha;
+
             u16 x, y, w, h;
             Word pos = cmd_words[0];
             Word size = cmd_words[1];
@@ -160,7 +396,7 @@ void VGUQueue::try_execute()
         {
             Color rgb = {};
             rgb.rgba = cmd_w & 0xFF'FFFF;
-            rgb.a = 0xFF;
+            rgb.a = VRasterizer::get_state().blend.color_alpha;
 
             u16 x, y, w, h;
             Word pos = cmd_words[0];
@@ -185,7 +421,7 @@ void VGUQueue::try_execute()
             VRasterizer::VertexColor v2 = {};
 
             *((Word*)&rgb) = cmd_w & 0xFF'FFFF;
-            rgb.a = 0xFF;
+            rgb.a = VRasterizer::get_state().blend.color_alpha;
 
             Word vertex0 = cmd_words[0];
             Word vertex1 = cmd_words[1];
@@ -217,7 +453,7 @@ void VGUQueue::try_execute()
             VRasterizer::VertexColor v2 = {};
 
             *((Word*)&rgb) = cmd_w & 0xFF'FFFF;
-            rgb.a = 0xFF;
+            rgb.a = VRasterizer::get_state().blend.color_alpha;
 
             Word vertex0 = cmd_words[0];
             Word vertex1 = cmd_words[1];
@@ -241,14 +477,58 @@ void VGUQueue::try_execute()
             VRasterizer::fill_triangle(v0, v1, v2);
         }
         break;
+        case GU::CMD_TEXTURED_TRIANGLE:
+        {
+            VRasterizer::VertexUV v[3] = {};
+            for (u32 i = 0; i < 3; i++)
+            {
+                Word position = cmd_words[i * 2];
+                Word uv = cmd_words[i * 2 + 1];
+
+                v[i].position.x = position & 0xFFFF;
+                v[i].position.y = (position >> 16);
+
+                // 12.4 fixed point
+                v[i].uv.x = (uv & 0xFFFF) / 16.0f;
+                v[i].uv.y = (uv >> 16) / 16.0f;
+            }
+            cmd_words += 6;
+            cmd_len -= 6;
+
+            VRasterizer::textured_triangle(v[0], v[1], v[2], cmd_w & 0xF);
+        }
+        break;
+        case GU::CMD_SPRITE:
+        {
+            Word pos = cmd_words[0];
+            Word size = cmd_words[1];
+            Word uv = cmd_words[2];
+            Word uv_size = cmd_words[3];
+            cmd_words += 4;
+            cmd_len -= 4;
+
+            VRasterizer::sprite(
+                Vector2I(pos & 0xFFFF, pos >> 16),
+                Vector2I(size & 0xFFFF, size >> 16),
+                Vector2I(uv & 0xFFFF, uv >> 16),
+                Vector2I(uv_size & 0xFFFF, uv_size >> 16),
+                cmd_w & 0xF
+            );
+        }
+        break;
+        case GU::CMD_DRAW:
+        case GU::CMD_DRAW_INDEXED:
+        {
+            Word first = cmd_words[0];
+            Word count = cmd_words[1];
+            cmd_words += 2;
+            cmd_len -= 2;
+
+            VRasterizer::draw_batch(GU::Topology(cmd_w & 0xF), first, count, cmd == GU::CMD_DRAW_INDEXED, (cmd_w >> 4) & 0xF);
+        }
+        break;
         default:
             break;
         }
     }
-
-    VRasterizer::reset_state();
-
-    state.cmd_list = 0;
-    state.cmd_len = 0;
-    state.signal = QUEUE_SIGNAL_IDLE;
 }
\ No newline at end of file
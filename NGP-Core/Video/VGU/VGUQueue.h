@@ -8,6 +8,8 @@
 #include "Video/GUDevice.h"
 #include "Video/Math.h"
 
+#include <vector>
+
 struct VGUQueue
 {
     enum QueueSignal
@@ -26,6 +28,8 @@ struct VGUQueue
 
         // Implementation data
         QueueSignal signal;
+        // The validated copy of the list, executed without checks
+        std::vector<Word> stream;
     };
 
     static inline GUQueueState state;
@@ -48,4 +52,9 @@ struct VGUQueue
     }
 
     static void try_execute();
+
+    // Checks the whole list against RAM once and copies every complete, known
+    // command in stream, following jumps and calls into the lists they target
+    static GU::QueueState validate(VirtualAddress cmd_list, Word cmd_len, std::vector<Word>& stream);
+    static void execute(const Word* stream, usize len);
 };
\ No newline at end of file
@@ -0,0 +1,274 @@
+/******************************************************/
+/*              This file is part of NGP              */
+/******************************************************/
+/*       Copyright (c) 2024-Present Jake-Insene       */
+/*        See the LICENSE in the project root.        */
+/******************************************************/
+#pragma once
+#include "IO/GU/GU.h"
+
+#include <cstring>
+#include <emmintrin.h>
+
+// Texel layouts of GU::TextureFormat, red is always in the low bits.
+// unpack returns an RGBA8 word (red in the low byte), pack truncates one.
+template<GU::TextureFormat Format>
+struct VPixelFormat;
+
+// Repeats the high bits of a component to fill 8 bits
+template<Word Bits>
+static constexpr Word expand_component(Word value)
+{
+    if constexpr (Bits == 1)
+        return value ? 0xFF : 0x00;
+    else
+        return (value << (8 - Bits)) | (value >> (2 * Bits - 8));
+}
+
+// Same as expand_component for the 16 bit lanes of a vector
+template<i32 Bits>
+static FORCE_INLINE __m128i expand_lanes(__m128i value)
+{
+    return _mm_or_si128(_mm_slli_epi16(value, 8 - Bits), _mm_srli_epi16(value, 2 * Bits - 8));
+}
+
+// 8 texels of a 16 bit format per iteration, Format::unpack_lanes widens the
+// channels to one 16 bit lane each
+template<typename Format>
+static void unpack_span_16(const u8* src, Word* dst, usize count)
+{
+    usize i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i r, g, b, a;
+        Format::unpack_lanes(_mm_loadu_si128((const __m128i*)(src + i * 2)), r, g, b, a);
+
+        const __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        const __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(rg, ba));
+    }
+
+    for (; i < count; i++)
+    {
+        dst[i] = Format::load(src + i * 2);
+    }
+}
+
+template<>
+struct VPixelFormat<GU::TEXTURE_FORMAT_RGBA8>
+{
+    static constexpr Word Size = 4;
+
+    static constexpr Word pack(Word rgba) { return rgba; }
+    static constexpr Word fill_pattern(Word rgba) { return rgba; }
+
+    static FORCE_INLINE Word load(const u8* texel)
+    {
+        Word value;
+        std::memcpy(&value, texel, sizeof(Word));
+        return value;
+    }
+
+    static FORCE_INLINE void store(u8* texel, Word rgba) { std::memcpy(texel, &rgba, sizeof(Word)); }
+
+    static void unpack_span(const u8* src, Word* dst, usize count) { std::memcpy(dst, src, count * sizeof(Word)); }
+};
+
+template<>
+struct VPixelFormat<GU::TEXTURE_FORMAT_RGB8>
+{
+    static constexpr Word Size = 3;
+
+    static FORCE_INLINE Word load(const u8* texel)
+    {
+        return Word(texel[0]) | (Word(texel[1]) << 8) | (Word(texel[2]) << 16) | 0xFF00'0000;
+    }
+
+    static FORCE_INLINE void store(u8* texel, Word rgba)
+    {
+        texel[0] = u8(rgba);
+        texel[1] = u8(rgba >> 8);
+        texel[2] = u8(rgba >> 16);
+    }
+
+    static void unpack_span(const u8* src, Word* dst, usize count)
+    {
+        for (usize i = 0; i < count; i++)
+        {
+            dst[i] = load(src + i * Size);
+        }
+    }
+};
+
+// [0 - 3] R, [4 - 7] G, [8 - 11] B, [12 - 15] A
+template<>
+struct VPixelFormat<GU::TEXTURE_FORMAT_RGBA4>
+{
+    static constexpr Word Size = 2;
+
+    static constexpr Word unpack(u16 value)
+    {
+        // x * 17 spreads a nibble over a byte
+        return ((value & 0xF) * 0x11) | (((value >> 4) & 0xF) * 0x11) << 8 |
+            (((value >> 8) & 0xF) * 0x11) << 16 | (((value >> 12) & 0xF) * 0x11) << 24;
+    }
+
+    static constexpr u16 pack(Word rgba)
+    {
+        return u16(((rgba >> 4) & 0xF) | ((rgba >> 8) & 0xF0) | ((rgba >> 12) & 0xF00) | ((rgba >> 16) & 0xF000));
+    }
+
+    static FORCE_INLINE void unpack_lanes(__m128i value, __m128i& r, __m128i& g, __m128i& b, __m128i& a)
+    {
+        const __m128i mask = _mm_set1_epi16(0xF);
+        r = expand_lanes<4>(_mm_and_si128(value, mask));
+        g = expand_lanes<4>(_mm_and_si128(_mm_srli_epi16(value, 4), mask));
+        b = expand_lanes<4>(_mm_and_si128(_mm_srli_epi16(value, 8), mask));
+        a = expand_lanes<4>(_mm_srli_epi16(value, 12));
+    }
+
+    static constexpr Word fill_pattern(Word rgba) { return Word(pack(rgba)) * 0x1'0001; }
+
+    static FORCE_INLINE Word load(const u8* texel)
+    {
+        u16 value;
+        std::memcpy(&value, texel, sizeof(u16));
+        return unpack(value);
+    }
+
+    static FORCE_INLINE void store(u8* texel, Word rgba)
+    {
+        const u16 value = pack(rgba);
+        std::memcpy(texel, &value, sizeof(u16));
+    }
+
+    static void unpack_span(const u8* src, Word* dst, usize count) { unpack_span_16<VPixelFormat>(src, dst, count); }
+};
+
+// [0 - 4] R, [5 - 10] G, [11 - 15] B
+template<>
+struct VPixelFormat<GU::TEXTURE_FORMAT_RGB565>
+{
+    static constexpr Word Size = 2;
+
+    static constexpr Word unpack(u16 value)
+    {
+        return expand_component<5>(value & 0x1F) | expand_component<6>((value >> 5) & 0x3F) << 8 |
+            expand_component<5>((value >> 11) & 0x1F) << 16 | 0xFF00'0000;
+    }
+
+    static constexpr u16 pack(Word rgba)
+    {
+        return u16(((rgba >> 3) & 0x1F) | ((rgba >> 5) & 0x7E0) | ((rgba >> 8) & 0xF800));
+    }
+
+    static FORCE_INLINE void unpack_lanes(__m128i value, __m128i& r, __m128i& g, __m128i& b, __m128i& a)
+    {
+        r = expand_lanes<5>(_mm_and_si128(value, _mm_set1_epi16(0x1F)));
+        g = expand_lanes<6>(_mm_and_si128(_mm_srli_epi16(value, 5), _mm_set1_epi16(0x3F)));
+        b = expand_lanes<5>(_mm_srli_epi16(value, 11));
+        a = _mm_set1_epi16(0xFF);
+    }
+
+    static constexpr Word fill_pattern(Word rgba) { return Word(pack(rgba)) * 0x1'0001; }
+
+    static FORCE_INLINE Word load(const u8* texel)
+    {
+        u16 value;
+        std::memcpy(&value, texel, sizeof(u16));
+        return unpack(value);
+    }
+
+    static FORCE_INLINE void store(u8* texel, Word rgba)
+    {
+        const u16 value = pack(rgba);
+        std::memcpy(texel, &value, sizeof(u16));
+    }
+
+    static void unpack_span(const u8* src, Word* dst, usize count) { unpack_span_16<VPixelFormat>(src, dst, count); }
+};
+
+// [0 - 4] R, [5 - 9] G, [10 - 14] B, [15] A
+template<>
+struct VPixelFormat<GU::TEXTURE_FORMAT_RGBA5551>
+{
+    static constexpr Word Size = 2;
+
+    static constexpr Word unpack(u16 value)
+    {
+        return expand_component<5>(value & 0x1F) | expand_component<5>((value >> 5) & 0x1F) << 8 |
+            expand_component<5>((value >> 10) & 0x1F) << 16 | expand_component<1>(value >> 15) << 24;
+    }
+
+    static constexpr u16 pack(Word rgba)
+    {
+        return u16(((rgba >> 3) & 0x1F) | ((rgba >> 6) & 0x3E0) | ((rgba >> 9) & 0x7C00) | ((rgba >> 16) & 0x8000));
+    }
+
+    static FORCE_INLINE void unpack_lanes(__m128i value, __m128i& r, __m128i& g, __m128i& b, __m128i& a)
+    {
+        const __m128i mask = _mm_set1_epi16(0x1F);
+        r = expand_lanes<5>(_mm_and_si128(value, mask));
+        g = expand_lanes<5>(_mm_and_si128(_mm_srli_epi16(value, 5), mask));
+        b = expand_lanes<5>(_mm_and_si128(_mm_srli_epi16(value, 10), mask));
+        a = _mm_and_si128(_mm_srai_epi16(value, 15), _mm_set1_epi16(0xFF));
+    }
+
+    static constexpr Word fill_pattern(Word rgba) { return Word(pack(rgba)) * 0x1'0001; }
+
+    static FORCE_INLINE Word load(const u8* texel)
+    {
+        u16 value;
+        std::memcpy(&value, texel, sizeof(u16));
+        return unpack(value);
+    }
+
+    static FORCE_INLINE void store(u8* texel, Word rgba)
+    {
+        const u16 value = pack(rgba);
+        std::memcpy(texel, &value, sizeof(u16));
+    }
+
+    static void unpack_span(const u8* src, Word* dst, usize count) { unpack_span_16<VPixelFormat>(src, dst, count); }
+};
+
+static_assert(VPixelFormat<GU::TEXTURE_FORMAT_RGB565>::unpack(0xFFFF) == 0xFFFF'FFFF);
+static_assert(VPixelFormat<GU::TEXTURE_FORMAT_RGBA5551>::unpack(0x7C1F) == 0x00FF'00FF);
+static_assert(VPixelFormat<GU::TEXTURE_FORMAT_RGBA4>::unpack(0xF00F) == 0xFF00'00FF);
+static_assert(VPixelFormat<GU::TEXTURE_FORMAT_RGB565>::pack(VPixelFormat<GU::TEXTURE_FORMAT_RGB565>::unpack(0x1234)) == 0x1234);
+static_assert(VPixelFormat<GU::TEXTURE_FORMAT_RGBA5551>::pack(VPixelFormat<GU::TEXTURE_FORMAT_RGBA5551>::unpack(0x9234)) == 0x9234);
+static_assert(VPixelFormat<GU::TEXTURE_FORMAT_RGBA4>::pack(VPixelFormat<GU::TEXTURE_FORMAT_RGBA4>::unpack(0x1234)) == 0x1234);
+
+// In bytes, indexed by GU::TextureFormat
+static constexpr Word TexelSize[GU::TEXTURE_FORMAT_COUNT] =
+{
+    VPixelFormat<GU::TEXTURE_FORMAT_RGBA8>::Size,
+    VPixelFormat<GU::TEXTURE_FORMAT_RGB8>::Size,
+    VPixelFormat<GU::TEXTURE_FORMAT_RGBA4>::Size,
+    VPixelFormat<GU::TEXTURE_FORMAT_RGB565>::Size,
+    VPixelFormat<GU::TEXTURE_FORMAT_RGBA5551>::Size,
+};
+
+// Widens count pixels of any format to RGBA8, unknown formats are copied as RGBA8
+static inline void unpack_pixels(GU::TextureFormat format, const u8* src, Word* dst, usize count)
+{
+    switch (format)
+    {
+    case GU::TEXTURE_FORMAT_RGB8:
+        VPixelFormat<GU::TEXTURE_FORMAT_RGB8>::unpack_span(src, dst, count);
+        break;
+    case GU::TEXTURE_FORMAT_RGBA4:
+        VPixelFormat<GU::TEXTURE_FORMAT_RGBA4>::unpack_span(src, dst, count);
+        break;
+    case GU::TEXTURE_FORMAT_RGB565:
+        VPixelFormat<GU::TEXTURE_FORMAT_RGB565>::unpack_span(src, dst, count);
+        break;
+    case GU::TEXTURE_FORMAT_RGBA5551:
+        VPixelFormat<GU::TEXTURE_FORMAT_RGBA5551>::unpack_span(src, dst, count);
+        break;
+    default:
+        VPixelFormat<GU::TEXTURE_FORMAT_RGBA8>::unpack_span(src, dst, count);
+        break;
+    }
+}
@@ -6,7 +6,39 @@
 /******************************************************/
 #include "Video/VGU/VRasterizer.h"
 #include "Video/VGU/VGU.h"
+#include "Video/VGU/VPixelFormat.h"
 
+#include "Core/HostMemory.h"
+
+#include <algorithm>
+#include <immintrin.h>
+#include <thread>
+
+static constexpr VRasterizer::BlendState ReplaceBlendState =
+{
+    .src_factor = GU::BLEND_ONE,
+    .dst_factor = GU::BLEND_ZERO,
+    .alpha_test = GU::ALPHA_TEST_ALWAYS,
+    .alpha_reference = 0,
+    .write_mask = GU::WRITE_MASK_RGBA,
+    .color_alpha = 0xFF,
+};
+
+// [target][blend]
+#define TARGET_FNS(fn) \
+    { \
+        { &fn<GU::TEXTURE_FORMAT_RGBA8, false>, &fn<GU::TEXTURE_FORMAT_RGBA8, true> }, \
+        { &fn<GU::TEXTURE_FORMAT_RGB8, false>, &fn<GU::TEXTURE_FORMAT_RGB8, true> }, \
+        { &fn<GU::TEXTURE_FORMAT_RGBA4, false>, &fn<GU::TEXTURE_FORMAT_RGBA4, true> }, \
+        { &fn<GU::TEXTURE_FORMAT_RGB565, false>, &fn<GU::TEXTURE_FORMAT_RGB565, true> }, \
+        { &fn<GU::TEXTURE_FORMAT_RGBA5551, false>, &fn<GU::TEXTURE_FORMAT_RGBA5551, true> }, \
+    }
+
+static constexpr VRasterizer::RasterFn LineFns[GU::TEXTURE_FORMAT_COUNT][2] = TARGET_FNS(VRasterizer::raster_line);
+static constexpr VRasterizer::RasterFn FillRectFns[GU::TEXTURE_FORMAT_COUNT][2] = TARGET_FNS(VRasterizer::raster_fill_rect);
+static constexpr VRasterizer::RasterFn FillTriangleFns[GU::TEXTURE_FORMAT_COUNT][2] = TARGET_FNS(VRasterizer::raster_fill_triangle);
+
+#undef TARGET_FNS
 
 void VRasterizer::initialize()
 {
@@ -15,69 +47,128 @@ void VRasterizer::initialize()
     state.draw_buffer.offset = Vector2I();
 
     state.put_pixel = PP_NONE;
+    set_blend_state(ReplaceBlendState);
+    set_vertex_buffer(0, 0, GU::VERTEX_FORMAT_COLOR);
+    set_index_buffer(0, 0);
+
+    state.primitives.clear();
+    state.tile_bins.clear();
+    state.busy_tiles.clear();
+    state.tiles_x = 0;
+    state.tiles_y = 0;
+
+    // The thread that runs the queue works on the tiles too
+    const u32 host_threads = std::max(std::thread::hardware_concurrency(), 2U);
+    workers.start(std::min(host_threads - 1, MaxRasterThreads - 1));
 }
 
-void VRasterizer::shutdown() {}
+void VRasterizer::shutdown()
+{
+    workers.stop();
+}
 
 void VRasterizer::reset_state()
 {
+    flush();
+
     state.draw_buffer.address = 0;
     state.draw_buffer.size = Vector2I();
     state.draw_buffer.offset = Vector2I();
 
     state.put_pixel = PP_NONE;
+    set_blend_state(ReplaceBlendState);
+    set_vertex_buffer(0, 0, GU::VERTEX_FORMAT_COLOR);
+    set_index_buffer(0, 0);
 }
 
-void VRasterizer::pixel(Vector2I position, Color rgb)
+void VRasterizer::set_draw_buffer(PhysicalAddress address, Vector2I size, 
+    Vector2I offset, GU::TextureFormat format)
 {
-    switch (state.put_pixel)
-    {
-    case PP_RGBA8:
-    {
-        if (position.x < 0 || position.x > state.draw_buffer.size.x
-            || position.y < 0 || position.y > state.draw_buffer.size.y)
-            return;
+    // Binned primitives target the previous buffer
+    flush();
 
-        Word* pixels = (Word*)state.draw_buffer.address;
-        pixels[(position.y * state.draw_buffer.size.x) + position.x] = rgb.rgba;
-    }
-    break;
-    default:
-        break;
+    // An unknown format drops every draw until the next draw buffer
+    if (format >= GU::TEXTURE_FORMAT_COUNT)
+    {
+        state.put_pixel = PP_NONE;
+        return;
     }
+
+    state.draw_buffer.address = address;
+    state.draw_buffer.size = size;
+    state.draw_buffer.offset = offset;
+    state.draw_buffer.format = format;
+    state.put_pixel = PP_DRAW_BUFFER;
+
+    state.draw_buffer.stride = size.x * i32(TexelSize[format]);
+
+    state.tiles_x = (size.x + TileSize - 1) >> TileShift;
+    state.tiles_y = (size.y + TileSize - 1) >> TileShift;
+    state.tile_bins.resize(usize(state.tiles_x) * state.tiles_y);
 }
 
-void VRasterizer::pixel_line(Vector2I position, i32 width, Color rgb)
+void VRasterizer::set_vertex_buffer(PhysicalAddress address, Word count, GU::VertexFormat format)
 {
-    switch (state.put_pixel)
-    {
-    case PP_RGBA8:
-    {
-        if (position.x < 0 || position.x + width > state.draw_buffer.size.x
-            || position.y < 0 || position.y >= state.draw_buffer.size.y)
-            return;
+    state.vertex_buffer.words = (const Word*)address;
+    state.vertex_buffer.count = format < GU::VERTEX_FORMAT_COUNT ? count : 0;
+    state.vertex_buffer.format = format;
+}
 
-        Word* pixels = ((Word*)state.draw_buffer.address) + state.draw_buffer.size.x * position.y;
-        for (i32 x = position.x; x < position.x + width; x++)
-        {
-            pixels[x] = rgb.rgba;
-        }
-    }
-    break;
-    default:
-        break;
-    }
+void VRasterizer::set_index_buffer(PhysicalAddress address, Word count)
+{
+    state.index_buffer.indices = (const u16*)address;
+    state.index_buffer.count = count;
 }
 
-void VRasterizer::set_draw_buffer(PhysicalAddress address, Vector2I size, 
-    Vector2I offset, GU::TextureFormat format)
+// { constant, src alpha, dst alpha } of every GU::BlendFactor
+static constexpr i32 BlendFactorTerms[GU::BLEND_FACTOR_COUNT][3] =
 {
-    state.draw_buffer.address = address;
-    state.draw_buffer.size = size;
-    state.draw_buffer.offset = offset;
-    state.draw_buffer.format = format;
+    { 0, 0, 0 },
+    { 255, 0, 0 },
+    { 0, 1, 0 },
+    { 255, -1, 0 },
+    { 0, 0, 1 },
+    { 255, 0, -1 },
+};
+
+bool VRasterizer::set_blend_state(const BlendState& blend)
+{
+    if (blend.src_factor >= GU::BLEND_FACTOR_COUNT || blend.dst_factor >= GU::BLEND_FACTOR_COUNT ||
+        blend.alpha_test >= GU::ALPHA_TEST_COUNT)
+        return false;
+
+    state.blend = blend;
+
+    BlendOp& op = state.blend_op;
+    for (u32 i = 0; i < 3; i++)
+    {
+        op.src_factor[i] = BlendFactorTerms[blend.src_factor][i];
+        op.dst_factor[i] = BlendFactorTerms[blend.dst_factor][i];
+    }
+
+    const i32 reference = blend.alpha_reference;
+    switch (blend.alpha_test)
+    {
+    case GU::ALPHA_TEST_ALWAYS: op.alpha_min = 0; op.alpha_max = 255; break;
+    case GU::ALPHA_TEST_NEVER: op.alpha_min = 1; op.alpha_max = 0; break;
+    case GU::ALPHA_TEST_LESS: op.alpha_min = 0; op.alpha_max = reference - 1; break;
+    case GU::ALPHA_TEST_LEQUAL: op.alpha_min = 0; op.alpha_max = reference; break;
+    case GU::ALPHA_TEST_EQUAL: op.alpha_min = reference; op.alpha_max = reference; break;
+    case GU::ALPHA_TEST_GEQUAL: op.alpha_min = reference; op.alpha_max = 255; break;
+    case GU::ALPHA_TEST_GREATER: op.alpha_min = reference + 1; op.alpha_max = 255; break;
+    default: break;
+    }
+
+    op.write_mask = 0;
+    for (u32 channel = 0; channel < 4; channel++)
+    {
+        if (blend.write_mask & (1 << channel))
+            op.write_mask |= 0xFFU << (channel * 8);
+    }
 
-    state.put_pixel = PP_RGBA8;
+    state.blending = blend.src_factor != GU::BLEND_ONE || blend.dst_factor != GU::BLEND_ZERO ||
+        blend.alpha_test != GU::ALPHA_TEST_ALWAYS || op.write_mask != 0xFFFF'FFFF;
+    return true;
 }
 
 Vector2 move_linear(Vector2 current, Vector2 target, float speed, float dt)
@@ -112,28 +203,85 @@ float approach(float current, float target, float delta)
     return current;
 }
 
-void VRasterizer::line(VertexColor p0, VertexColor p1)
+static i32 round_div(i64 numerator, i64 denominator)
 {
-    i32 x0 = (i32)std::round(p0.position.x);
-    i32 y0 = (i32)std::round(p0.position.y);
-    i32 x1 = (i32)std::round(p1.position.x);
-    i32 y1 = (i32)std::round(p1.position.y);
+    return i32(numerator >= 0 ?
+        (numerator + denominator / 2) / denominator :
+        -((-numerator + denominator / 2) / denominator));
+}
 
-    i32 dx = std::abs(x1 - x0);
-    i32 dy = -std::abs(y1 - y0);
-    i32 sx = (x0 < x1) ? 1 : -1;
-    i32 sy = (y0 < y1) ? 1 : -1;
-    i32 err = dx + dy;
+static VRasterizer::Bounds vertex_bounds(const VRasterizer::VertexColor* v, u32 count)
+{
+    VRasterizer::Bounds bounds = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+    for (u32 i = 0; i < count; i++)
+    {
+        const i32 x = (i32)std::round(v[i].position.x);
+        const i32 y = (i32)std::round(v[i].position.y);
+        bounds.min_x = std::min(bounds.min_x, x);
+        bounds.min_y = std::min(bounds.min_y, y);
+        bounds.max_x = std::max(bounds.max_x, x + 1);
+        bounds.max_y = std::max(bounds.max_y, y + 1);
+    }
+
+    return bounds;
+}
 
-    while (true)
+void VRasterizer::clear(Color color)
+{
+    if (state.put_pixel == PP_NONE)
+        return;
+
+    // Everything binned so far would be overwritten
+    for (u32 tile : state.busy_tiles)
     {
-        pixel(Vector2I(x0, y0), p0.color);
+        state.tile_bins[tile].clear();
+    }
+    state.busy_tiles.clear();
+    state.primitives.clear();
 
-        if (x0 == x1 && y0 == y1) break;
-        i32 e2 = 2 * err;
-        if (e2 >= dy) { err += dy; x0 += sx; }
-        if (e2 <= dx) { err += dx; y0 += sy; }
+    // The pattern repeats every word except for RGB8, which is filled per pixel
+    Word pattern = color.rgba;
+    switch (state.draw_buffer.format)
+    {
+    case GU::TEXTURE_FORMAT_RGBA4: pattern = VPixelFormat<GU::TEXTURE_FORMAT_RGBA4>::fill_pattern(color.rgba); break;
+    case GU::TEXTURE_FORMAT_RGB565: pattern = VPixelFormat<GU::TEXTURE_FORMAT_RGB565>::fill_pattern(color.rgba); break;
+    case GU::TEXTURE_FORMAT_RGBA5551: pattern = VPixelFormat<GU::TEXTURE_FORMAT_RGBA5551>::fill_pattern(color.rgba); break;
+    default: break;
     }
+
+    // One band of tile rows per task, the draw buffer is contiguous
+    workers.parallel_for(
+        u32(state.tiles_y),
+        [](void* user, u32 band)
+        {
+            const i32 y = i32(band) << TileShift;
+            const i32 rows = std::min(TileSize, state.draw_buffer.size.y - y);
+            u8* pixels = (u8*)state.draw_buffer.address + usize(y) * state.draw_buffer.stride;
+            const usize size = usize(rows) * state.draw_buffer.stride;
+
+            if (state.draw_buffer.format == GU::TEXTURE_FORMAT_RGB8)
+            {
+                for (usize offset = 0; offset < size; offset += VPixelFormat<GU::TEXTURE_FORMAT_RGB8>::Size)
+                {
+                    VPixelFormat<GU::TEXTURE_FORMAT_RGB8>::store(pixels + offset, *(const Word*)user);
+                }
+                return;
+            }
+
+            HostMemory::stream_fill_word(pixels, *(const Word*)user, size);
+        },
+        &pattern
+    );
+}
+
+void VRasterizer::line(VertexColor p0, VertexColor p1)
+{
+    Primitive primitive = {};
+    primitive.raster = LineFns[state.draw_buffer.format][state.blending];
+    primitive.v[0] = p0;
+    primitive.v[1] = p1;
+    primitive.bounds = vertex_bounds(primitive.v, 2);
+    bin(primitive);
 }
 
 void VRasterizer::rect(Vector2 position, Vector2 size, Color color)
@@ -144,19 +292,21 @@ void VRasterizer::rect(Vector2 position, Vector2 size, Color color)
     VertexColor v3 = VertexColor(position + size, color);
 
     line(v0, v1);
-    line(v1, v2);
-    line(v2, v3);
-    line(v3, v1);
+    line(v1, v3);
+    line(v3, v2);
+    line(v2, v0);
 }
 
 void VRasterizer::fill_rect(Vector2 position, Vector2 size, Color color)
 {
-    VGU::VFramebuffer& fb = VGU::get_current_framebuffer();
-
-    for (i32 y1 = position.y; y1 < position.y + size.y; y1++)
-    {
-        pixel_line(Vector2I(position.x, y1), size.x, color);
-    }
+    Primitive primitive = {};
+    primitive.raster = FillRectFns[state.draw_buffer.format][state.blending];
+    primitive.v[0] = VertexColor(position, color);
+    primitive.bounds.min_x = (i32)position.x;
+    primitive.bounds.min_y = (i32)position.y;
+    primitive.bounds.max_x = (i32)(position.x + size.x);
+    primitive.bounds.max_y = (i32)(position.y + size.y);
+    bin(primitive);
 }
 
 void VRasterizer::triangle(VertexColor v0, VertexColor v1, VertexColor v2)
@@ -166,72 +316,1062 @@ void VRasterizer::triangle(VertexColor v0, VertexColor v1, VertexColor v2)
     line(v2, v0);
 }
 
-Color shade(VRasterizer::VertexColor v0, VRasterizer::VertexColor v1, 
-    VRasterizer::VertexColor v2, int w0, int w1, int w2, int denom)
+void VRasterizer::fill_triangle(VertexColor v0, VertexColor v1, VertexColor v2)
 {
-    Color output = {};
-    output.r = (int(v0.color.r) * w0 + int(v1.color.r) * w1 + int(v2.color.r) * w2) / denom;
-    output.g = (int(v0.color.g) * w0 + int(v1.color.g) * w1 + int(v2.color.g) * w2) / denom;
-    output.b = (int(v0.color.b) * w0 + int(v1.color.b) * w1 + int(v2.color.b) * w2) / denom;
-    output.a = 255;
-    return output;
+    Primitive primitive = {};
+    primitive.raster = FillTriangleFns[state.draw_buffer.format][state.blending];
+    primitive.v[0] = v0;
+    primitive.v[1] = v1;
+    primitive.v[2] = v2;
+    bin_triangle(primitive);
 }
 
-void VRasterizer::fill_triangle(VertexColor v0, VertexColor v1, VertexColor v2)
+void VRasterizer::bin(const Primitive& primitive)
 {
-    int x0 = (int)std::round(v0.position.x), y0 = (int)std::round(v0.position.y);
-    int x1 = (int)std::round(v1.position.x), y1 = (int)std::round(v1.position.y);
-    int x2 = (int)std::round(v2.position.x), y2 = (int)std::round(v2.position.y);
+    if (state.put_pixel == PP_NONE)
+        return;
+
+    // Clipped to the draw buffer
+    Bounds bounds = primitive.bounds;
+    bounds.min_x = std::max(bounds.min_x, 0);
+    bounds.min_y = std::max(bounds.min_y, 0);
+    bounds.max_x = std::min(bounds.max_x, state.draw_buffer.size.x);
+    bounds.max_y = std::min(bounds.max_y, state.draw_buffer.size.y);
+    if (bounds.min_x >= bounds.max_x || bounds.min_y >= bounds.max_y)
+        return;
+
+    const u32 index = u32(state.primitives.size());
+    state.primitives.emplace_back(primitive).blend = state.blend_op;
 
-    // Bounding box (clipped to draw buffer)
-    int minX = std::max(0, std::min({ x0, x1, x2 }));
-    int maxX = std::min(state.draw_buffer.size.x - 1, std::max({ x0, x1, x2 }));
-    int minY = std::max(0, std::min({ y0, y1, y2 }));
-    int maxY = std::min(state.draw_buffer.size.y - 1, std::max({ y0, y1, y2 }));
-    if (minX > maxX || minY > maxY) return;
+    const i32 tile_x0 = bounds.min_x >> TileShift;
+    const i32 tile_x1 = (bounds.max_x - 1) >> TileShift;
+    const i32 tile_y0 = bounds.min_y >> TileShift;
+    const i32 tile_y1 = (bounds.max_y - 1) >> TileShift;
+    for (i32 ty = tile_y0; ty <= tile_y1; ty++)
+    {
+        for (i32 tx = tile_x0; tx <= tile_x1; tx++)
+        {
+            const u32 tile = u32(ty * state.tiles_x + tx);
+            std::vector<u32>& tile_bin = state.tile_bins[tile];
+            if (tile_bin.empty())
+            {
+                state.busy_tiles.emplace_back(tile);
+            }
+            tile_bin.emplace_back(index);
+        }
+    }
+
+    if (state.primitives.size() >= MaxBinnedPrimitives)
+    {
+        flush();
+    }
+}
 
-    // Edge setup
-    int A01 = y0 - y1, B01 = x1 - x0;
-    int A12 = y1 - y2, B12 = x2 - x1;
-    int A20 = y2 - y0, B20 = x0 - x2;
+static VRasterizer::BatchVertex lerp_vertex(const VRasterizer::BatchVertex& a, const VRasterizer::BatchVertex& b, f32 t)
+{
+    VRasterizer::BatchVertex result;
+    result.vertex.position = a.vertex.position + (b.vertex.position - a.vertex.position) * t;
+    result.vertex.color.r = u8(std::round(a.vertex.color.r + (b.vertex.color.r - a.vertex.color.r) * t));
+    result.vertex.color.g = u8(std::round(a.vertex.color.g + (b.vertex.color.g - a.vertex.color.g) * t));
+    result.vertex.color.b = u8(std::round(a.vertex.color.b + (b.vertex.color.b - a.vertex.color.b) * t));
+    result.vertex.color.a = a.vertex.color.a;
+    result.uv.x = a.uv.x + i32(std::round(f32(b.uv.x - a.uv.x) * t));
+    result.uv.y = a.uv.y + i32(std::round(f32(b.uv.y - a.uv.y) * t));
+    return result;
+}
 
-    // Triangle area (twice the area). If 0 -> degenerate.
-    int denom = A12 * (x0 - x2) + B12 * (y0 - y2);
-    if (denom == 0) return;
+void VRasterizer::bin_triangle(Primitive& primitive)
+{
+    const auto inside = [](const VertexColor& v)
+    {
+        return std::abs(v.position.x) <= GuardBand && std::abs(v.position.y) <= GuardBand;
+    };
 
-    // Normalize orientation so denom > 0 (flip everything if needed)
-    if (denom < 0)
+    if (inside(primitive.v[0]) && inside(primitive.v[1]) && inside(primitive.v[2])) [[likely]]
     {
-        denom = -denom;
-        A01 = -A01; B01 = -B01;
-        A12 = -A12; B12 = -B12;
-        A20 = -A20; B20 = -B20;
+        primitive.bounds = vertex_bounds(primitive.v, 3);
+        bin(primitive);
+        return;
     }
 
-    // Edge function values at (minX, minY)
-    int w0_row = A12 * (minX - x2) + B12 * (minY - y2);
-    int w1_row = A20 * (minX - x0) + B20 * (minY - y0);
-    int w2_row = A01 * (minX - x1) + B01 * (minY - y1);
+    // Clipped to one side of the band at a time, at most 7 vertices are left
+    BatchVertex polygon[2][8];
+    u32 count = 3;
+    u32 current = 0;
+    for (u32 i = 0; i < 3; i++)
+    {
+        polygon[0][i] = { primitive.v[i], primitive.uv[i] };
+    }
 
-    // Rasterize (>= 0 works now that denom is positive)
-    for (int y = minY; y <= maxY; ++y)
+    for (u32 side = 0; side < 4 && count; side++)
     {
-        int w0 = w0_row, w1 = w1_row, w2 = w2_row;
+        // >= 0 inside the side
+        const auto distance = [side](const BatchVertex& v)
+        {
+            const f32 value = side & 2 ? v.vertex.position.y : v.vertex.position.x;
+            return f32(GuardBand) - (side & 1 ? -value : value);
+        };
 
-        for (int x = minX; x <= maxX; ++x)
+        const BatchVertex* in = polygon[current];
+        BatchVertex* out = polygon[current ^ 1];
+        u32 out_count = 0;
+        for (u32 i = 0; i < count; i++)
         {
-            if (w0 >= 0 && w1 >= 0 && w2 >= 0)
+            const BatchVertex& a = in[i];
+            const BatchVertex& b = in[(i + 1) % count];
+            const f32 distance_a = distance(a);
+            const f32 distance_b = distance(b);
+
+            if (distance_a >= 0)
+                out[out_count++] = a;
+
+            if ((distance_a >= 0) != (distance_b >= 0))
+                out[out_count++] = lerp_vertex(a, b, distance_a / (distance_a - distance_b));
+        }
+
+        count = out_count;
+        current ^= 1;
+    }
+
+    // The alpha of a filled triangle is flat, taken from its first vertex
+    const u8 alpha = primitive.v[0].color.a;
+    const BatchVertex* fan = polygon[current];
+    for (u32 i = 1; i + 1 < count; i++)
+    {
+        const BatchVertex* vertices[3] = { &fan[0], &fan[i], &fan[i + 1] };
+        for (u32 v = 0; v < 3; v++)
+        {
+            primitive.v[v] = vertices[v]->vertex;
+            primitive.uv[v] = vertices[v]->uv;
+        }
+        primitive.v[0].color.a = alpha;
+
+        primitive.bounds = vertex_bounds(primitive.v, 3);
+        bin(primitive);
+    }
+}
+
+void VRasterizer::flush()
+{
+    if (state.primitives.empty())
+        return;
+
+    workers.parallel_for(
+        u32(state.busy_tiles.size()),
+        [](void*, u32 index) { rasterize_tile(state.busy_tiles[index]); },
+        nullptr
+    );
+
+    for (u32 tile : state.busy_tiles)
+    {
+        state.tile_bins[tile].clear();
+    }
+    state.busy_tiles.clear();
+    state.primitives.clear();
+}
+
+void VRasterizer::rasterize_tile(u32 tile)
+{
+    const i32 tx = i32(tile) % state.tiles_x;
+    const i32 ty = i32(tile) / state.tiles_x;
+
+    Bounds clip;
+    clip.min_x = tx << TileShift;
+    clip.min_y = ty << TileShift;
+    clip.max_x = std::min(clip.min_x + TileSize, state.draw_buffer.size.x);
+    clip.max_y = std::min(clip.min_y + TileSize, state.draw_buffer.size.y);
+
+    for (u32 index : state.tile_bins[tile])
+    {
+        const Primitive& primitive = state.primitives[index];
+        primitive.raster(primitive, clip);
+    }
+}
+
+// Branch free, every choice of the blend state is in the op
+static FORCE_INLINE Word blend_pixel(Word src, Word dst, const VRasterizer::BlendOp& op)
+{
+    const i32 src_alpha = i32(src >> 24);
+    const i32 dst_alpha = i32(dst >> 24);
+    const i32 src_factor = op.src_factor[0] + op.src_factor[1] * src_alpha + op.src_factor[2] * dst_alpha;
+    const i32 dst_factor = op.dst_factor[0] + op.dst_factor[1] * src_alpha + op.dst_factor[2] * dst_alpha;
+
+    Word result = 0;
+    for (u32 shift = 0; shift < 32; shift += 8)
+    {
+        const i32 value = i32((src >> shift) & 0xFF) * src_factor + i32((dst >> shift) & 0xFF) * dst_factor + 128;
+        // value / 255, saturated for the additive factors
+        result |= Word(std::min((value + (value >> 8)) >> 8, 255)) << shift;
+    }
+    result = (result & op.write_mask) | (dst & ~op.write_mask);
+
+    const bool pass = src_alpha >= op.alpha_min && src_alpha <= op.alpha_max;
+    return pass ? result : dst;
+}
+
+template<GU::TextureFormat Target, bool Blend>
+static FORCE_INLINE void write_pixel(u8* pixel, Word color, const VRasterizer::BlendOp& op)
+{
+    if constexpr (Blend)
+        color = blend_pixel(color, VPixelFormat<Target>::load(pixel), op);
+
+    VPixelFormat<Target>::store(pixel, color);
+}
+
+template<GU::TextureFormat Target>
+static FORCE_INLINE u8* target_pixel(i32 x, i32 y)
+{
+    return (u8*)VRasterizer::state.draw_buffer.address + usize(y) * VRasterizer::state.draw_buffer.stride +
+        usize(x) * VPixelFormat<Target>::Size;
+}
+
+// Walks the major axis inside the clip, so a tile only pays for its own pixels
+template<GU::TextureFormat Target, bool Blend>
+void VRasterizer::raster_line(const Primitive& primitive, const Bounds& clip)
+{
+    i32 x0 = (i32)std::round(primitive.v[0].position.x);
+    i32 y0 = (i32)std::round(primitive.v[0].position.y);
+    i32 x1 = (i32)std::round(primitive.v[1].position.x);
+    i32 y1 = (i32)std::round(primitive.v[1].position.y);
+
+    const Word color = primitive.v[0].color.rgba;
+
+    const bool x_major = std::abs(x1 - x0) >= std::abs(y1 - y0);
+    if (!x_major)
+    {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+    }
+    if (x0 > x1)
+    {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+    }
+
+    const i32 major_min = x_major ? clip.min_x : clip.min_y;
+    const i32 major_max = x_major ? clip.max_x : clip.max_y;
+    const i32 minor_min = x_major ? clip.min_y : clip.min_x;
+    const i32 minor_max = x_major ? clip.max_y : clip.max_x;
+
+    const i32 start = std::max(x0, major_min);
+    const i32 end = std::min(x1 + 1, major_max);
+    for (i32 major = start; major < end; major++)
+    {
+        const i32 minor = x0 == x1 ? y0 : y0 + round_div(i64(major - x0) * (y1 - y0), x1 - x0);
+        if (minor < minor_min || minor >= minor_max)
+            continue;
+
+        if (x_major)
+            write_pixel<Target, Blend>(target_pixel<Target>(major, minor), color, primitive.blend);
+        else
+            write_pixel<Target, Blend>(target_pixel<Target>(minor, major), color, primitive.blend);
+    }
+}
+
+template<GU::TextureFormat Target, bool Blend>
+void VRasterizer::raster_fill_rect(const Primitive& primitive, const Bounds& clip)
+{
+    const i32 min_x = std::max(primitive.bounds.min_x, clip.min_x);
+    const i32 max_x = std::min(primitive.bounds.max_x, clip.max_x);
+    const i32 min_y = std::max(primitive.bounds.min_y, clip.min_y);
+    const i32 max_y = std::min(primitive.bounds.max_y, clip.max_y);
+    if (min_x >= max_x || min_y >= max_y)
+        return;
+
+    const Word color = primitive.v[0].color.rgba;
+    const usize span = usize(max_x - min_x) * VPixelFormat<Target>::Size;
+    u8* row = target_pixel<Target>(min_x, min_y);
+    for (i32 y = min_y; y < max_y; y++, row += state.draw_buffer.stride)
+    {
+        // RGB8 has no word pattern
+        if constexpr (Blend || Target == GU::TEXTURE_FORMAT_RGB8)
+        {
+            for (usize x = 0; x < span; x += VPixelFormat<Target>::Size)
+            {
+                write_pixel<Target, Blend>(row + x, color, primitive.blend);
+            }
+        }
+        else
+        {
+            HostMemory::fill_word(row, VPixelFormat<Target>::fill_pattern(color), span);
+        }
+    }
+}
+
+// Fixed point setup of a filled triangle, shared by the vector kernels
+struct TriangleSetup
+{
+    i32 x0, y0, x1, y1, x2, y2;
+    i32 a01, b01, a12, b12, a20, b20;
+    i32 denom;
+    // [vertex][channel]
+    i32 color[3][3];
+    // 16.16 color steps for x++ and y++
+    i32 color_dx[3];
+    i32 color_dy[3];
+    // Flat alpha of the first vertex, in the top byte
+    Word alpha;
+};
+
+static FORCE_INLINE i32 edge12(const TriangleSetup& t, i32 x, i32 y) { return t.a12 * (x - t.x2) + t.b12 * (y - t.y2); }
+static FORCE_INLINE i32 edge20(const TriangleSetup& t, i32 x, i32 y) { return t.a20 * (x - t.x0) + t.b20 * (y - t.y0); }
+static FORCE_INLINE i32 edge01(const TriangleSetup& t, i32 x, i32 y) { return t.a01 * (x - t.x1) + t.b01 * (y - t.y1); }
+
+// One divide per channel at the start of a block, the block steps in 16.16
+static FORCE_INLINE i32 color_at(const TriangleSetup& t, u32 channel, i32 w0, i32 w1, i32 w2)
+{
+    const i64 weighted = i64(t.color[0][channel]) * w0 + i64(t.color[1][channel]) * w1 + i64(t.color[2][channel]) * w2;
+    return i32((weighted << 16) / t.denom);
+}
+
+static FORCE_INLINE Word pack_color(i32 r, i32 g, i32 b, Word alpha)
+{
+    return Word(std::max(r, 0) >> 16) | (Word(std::max(g, 0) >> 16) << 8) | (Word(std::max(b, 0) >> 16) << 16) | alpha;
+}
+
+struct RasterLanesSSE2
+{
+    using V = __m128i;
+    static constexpr i32 Width = 4;
+
+    static FORCE_INLINE V set1(i32 value) { return _mm_set1_epi32(value); }
+    static FORCE_INLINE V ramp(i32 base, i32 step) { return _mm_setr_epi32(base, base + step, base + step * 2, base + step * 3); }
+    static FORCE_INLINE V add(V a, V b) { return _mm_add_epi32(a, b); }
+    static FORCE_INLINE i32 first(V v) { return _mm_cvtsi128_si32(v); }
+
+    // Inside when no edge value has the sign bit
+    static FORCE_INLINE V inside(V w0, V w1, V w2) { return _mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(w0, w1), w2), _mm_set1_epi32(-1)); }
+    static FORCE_INLINE bool any(V mask) { return _mm_movemask_epi8(mask) != 0; }
+
+    static FORCE_INLINE V channel(V value, i32 shift)
+    {
+        value = _mm_andnot_si128(_mm_srai_epi32(value, 31), value);
+        return _mm_slli_epi32(_mm_srli_epi32(value, 16), shift);
+    }
+
+    static FORCE_INLINE V pack(V r, V g, V b, V alpha)
+    {
+        return _mm_or_si128(_mm_or_si128(channel(r, 0), channel(g, 8)), _mm_or_si128(channel(b, 16), alpha));
+    }
+
+    static FORCE_INLINE V load(const Word* pixels) { return _mm_loadu_si128((const __m128i*)pixels); }
+    static FORCE_INLINE void store(Word* pixels, V v) { _mm_storeu_si128((__m128i*)pixels, v); }
+    static FORCE_INLINE V select(V mask, V a, V b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+};
+
+#if defined(__AVX2__)
+struct RasterLanesAVX2
+{
+    using V = __m256i;
+    static constexpr i32 Width = 8;
+
+    static FORCE_INLINE V set1(i32 value) { return _mm256_set1_epi32(value); }
+    static FORCE_INLINE V ramp(i32 base, i32 step) { return _mm256_add_epi32(_mm256_set1_epi32(base), _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(step))); }
+    static FORCE_INLINE V add(V a, V b) { return _mm256_add_epi32(a, b); }
+    static FORCE_INLINE i32 first(V v) { return _mm_cvtsi128_si32(_mm256_castsi256_si128(v)); }
+
+    static FORCE_INLINE V inside(V w0, V w1, V w2) { return _mm256_cmpgt_epi32(_mm256_or_si256(_mm256_or_si256(w0, w1), w2), _mm256_set1_epi32(-1)); }
+    static FORCE_INLINE bool any(V mask) { return _mm256_movemask_epi8(mask) != 0; }
+
+    static FORCE_INLINE V channel(V value, i32 shift)
+    {
+        value = _mm256_max_epi32(value, _mm256_setzero_si256());
+        return _mm256_slli_epi32(_mm256_srli_epi32(value, 16), shift);
+    }
+
+    static FORCE_INLINE V pack(V r, V g, V b, V alpha)
+    {
+        return _mm256_or_si256(_mm256_or_si256(channel(r, 0), channel(g, 8)), _mm256_or_si256(channel(b, 16), alpha));
+    }
+
+    static FORCE_INLINE V load(const Word* pixels) { return _mm256_loadu_si256((const __m256i*)pixels); }
+    static FORCE_INLINE void store(Word* pixels, V v) { _mm256_storeu_si256((__m256i*)pixels, v); }
+    static FORCE_INLINE V select(V mask, V a, V b) { return _mm256_blendv_epi8(b, a, mask); }
+};
+
+using RasterLanes = RasterLanesAVX2;
+#else
+using RasterLanes = RasterLanesSSE2;
+#endif // __AVX2__
+
+// Pixels [x, x_end) of a row from the values at x, covered spans skip the edge tests
+template<typename L>
+static void triangle_span(const TriangleSetup& t, Word* row, i32 x, i32 x_end, bool covered,
+    i32 w0, i32 w1, i32 w2, i32 r, i32 g, i32 b)
+{
+    if (x + L::Width <= x_end)
+    {
+        typename L::V vw0 = L::ramp(w0, t.a12);
+        typename L::V vw1 = L::ramp(w1, t.a20);
+        typename L::V vw2 = L::ramp(w2, t.a01);
+        typename L::V vr = L::ramp(r, t.color_dx[0]);
+        typename L::V vg = L::ramp(g, t.color_dx[1]);
+        typename L::V vb = L::ramp(b, t.color_dx[2]);
+
+        const typename L::V step_w0 = L::set1(t.a12 * L::Width);
+        const typename L::V step_w1 = L::set1(t.a20 * L::Width);
+        const typename L::V step_w2 = L::set1(t.a01 * L::Width);
+        const typename L::V step_r = L::set1(t.color_dx[0] * L::Width);
+        const typename L::V step_g = L::set1(t.color_dx[1] * L::Width);
+        const typename L::V step_b = L::set1(t.color_dx[2] * L::Width);
+        const typename L::V alpha = L::set1(i32(t.alpha));
+
+        for (; x + L::Width <= x_end; x += L::Width)
+        {
+            const typename L::V color = L::pack(vr, vg, vb, alpha);
+            if (covered)
+            {
+                L::store(row + x, color);
+            }
+            else
             {
-                pixel(Vector2I(x, y), shade(v0, v1, v2, w0, w1, w2, denom));
+                const typename L::V mask = L::inside(vw0, vw1, vw2);
+                if (L::any(mask))
+                {
+                    L::store(row + x, L::select(mask, color, L::load(row + x)));
+                }
             }
-            w0 += A12;  // step E12 by +A12 when x++
-            w1 += A20;  // step E20 by +A20
-            w2 += A01;  // step E01 by +A01
+
+            vw0 = L::add(vw0, step_w0);
+            vw1 = L::add(vw1, step_w1);
+            vw2 = L::add(vw2, step_w2);
+            vr = L::add(vr, step_r);
+            vg = L::add(vg, step_g);
+            vb = L::add(vb, step_b);
         }
 
-        w0_row += B12; // step by +B12 when y++
-        w1_row += B20;
-        w2_row += B01;
+        w0 = L::first(vw0);
+        w1 = L::first(vw1);
+        w2 = L::first(vw2);
+        r = L::first(vr);
+        g = L::first(vg);
+        b = L::first(vb);
     }
+
+    for (; x < x_end; x++)
+    {
+        if (covered || (w0 | w1 | w2) >= 0)
+        {
+            row[x] = pack_color(r, g, b, t.alpha);
+        }
+
+        w0 += t.a12;
+        w1 += t.a20;
+        w2 += t.a01;
+        r += t.color_dx[0];
+        g += t.color_dx[1];
+        b += t.color_dx[2];
+    }
+}
+
+// A full 8 pixel wide block, the lanes step down the rows without any setup
+template<typename L>
+static void triangle_block(const TriangleSetup& t, Word* row, i32 stride, i32 rows, bool covered,
+    i32 w0, i32 w1, i32 w2, i32 r, i32 g, i32 b)
+{
+    static constexpr i32 Groups = 8 / L::Width;
+
+    typename L::V vw0[Groups], vw1[Groups], vw2[Groups];
+    typename L::V vr[Groups], vg[Groups], vb[Groups];
+    for (i32 i = 0; i < Groups; i++)
+    {
+        const i32 offset = i * L::Width;
+        vw0[i] = L::ramp(w0 + t.a12 * offset, t.a12);
+        vw1[i] = L::ramp(w1 + t.a20 * offset, t.a20);
+        vw2[i] = L::ramp(w2 + t.a01 * offset, t.a01);
+        vr[i] = L::ramp(r + t.color_dx[0] * offset, t.color_dx[0]);
+        vg[i] = L::ramp(g + t.color_dx[1] * offset, t.color_dx[1]);
+        vb[i] = L::ramp(b + t.color_dx[2] * offset, t.color_dx[2]);
+    }
+
+    const typename L::V step_w0 = L::set1(t.b12);
+    const typename L::V step_w1 = L::set1(t.b20);
+    const typename L::V step_w2 = L::set1(t.b01);
+    const typename L::V step_r = L::set1(t.color_dy[0]);
+    const typename L::V step_g = L::set1(t.color_dy[1]);
+    const typename L::V step_b = L::set1(t.color_dy[2]);
+    const typename L::V alpha = L::set1(i32(t.alpha));
+
+    for (i32 y = 0; y < rows; y++, row += stride)
+    {
+        for (i32 i = 0; i < Groups; i++)
+        {
+            const typename L::V color = L::pack(vr[i], vg[i], vb[i], alpha);
+            if (covered)
+            {
+                L::store(row + i * L::Width, color);
+            }
+            else
+            {
+                const typename L::V mask = L::inside(vw0[i], vw1[i], vw2[i]);
+                if (L::any(mask))
+                {
+                    L::store(row + i * L::Width, L::select(mask, color, L::load(row + i * L::Width)));
+                }
+            }
+
+            vw0[i] = L::add(vw0[i], step_w0);
+            vw1[i] = L::add(vw1[i], step_w1);
+            vw2[i] = L::add(vw2[i], step_w2);
+            vr[i] = L::add(vr[i], step_r);
+            vg[i] = L::add(vg[i], step_g);
+            vb[i] = L::add(vb[i], step_b);
+        }
+    }
+}
+
+// Edge setup clipped to the tile, area max is inclusive. False for degenerate
+// or fully clipped triangles
+static bool setup_triangle(TriangleSetup& t, const VRasterizer::Primitive& primitive,
+    const VRasterizer::Bounds& clip, VRasterizer::Bounds& area)
+{
+    t.x0 = (i32)std::round(primitive.v[0].position.x); t.y0 = (i32)std::round(primitive.v[0].position.y);
+    t.x1 = (i32)std::round(primitive.v[1].position.x); t.y1 = (i32)std::round(primitive.v[1].position.y);
+    t.x2 = (i32)std::round(primitive.v[2].position.x); t.y2 = (i32)std::round(primitive.v[2].position.y);
+
+    area.min_x = std::max(clip.min_x, std::min({ t.x0, t.x1, t.x2 }));
+    area.max_x = std::min(clip.max_x - 1, std::max({ t.x0, t.x1, t.x2 }));
+    area.min_y = std::max(clip.min_y, std::min({ t.y0, t.y1, t.y2 }));
+    area.max_y = std::min(clip.max_y - 1, std::max({ t.y0, t.y1, t.y2 }));
+    if (area.min_x > area.max_x || area.min_y > area.max_y)
+        return false;
+
+    t.a01 = t.y0 - t.y1; t.b01 = t.x1 - t.x0;
+    t.a12 = t.y1 - t.y2; t.b12 = t.x2 - t.x1;
+    t.a20 = t.y2 - t.y0; t.b20 = t.x0 - t.x2;
+
+    // Twice the area, 0 is degenerate
+    t.denom = t.a12 * (t.x0 - t.x2) + t.b12 * (t.y0 - t.y2);
+    if (t.denom == 0)
+        return false;
+
+    // Normalize the orientation so inside is >= 0
+    if (t.denom < 0)
+    {
+        t.denom = -t.denom;
+        t.a01 = -t.a01; t.b01 = -t.b01;
+        t.a12 = -t.a12; t.b12 = -t.b12;
+        t.a20 = -t.a20; t.b20 = -t.b20;
+    }
+
+    return true;
+}
+
+// 8x8 blocks, an edge is linear so its corners bound the whole block.
+// fn(x_start, x_end, y_start, y_end, covered, w0, w1, w2) for every block that isn't rejected
+template<typename Fn>
+static FORCE_INLINE void for_each_block(const TriangleSetup& t, const VRasterizer::Bounds& area, Fn&& fn)
+{
+    for (i32 block_y = area.min_y & ~7; block_y <= area.max_y; block_y += 8)
+    {
+        const i32 y_start = std::max(block_y, area.min_y);
+        const i32 y_end = std::min(block_y + 8, area.max_y + 1);
+
+        for (i32 block_x = area.min_x & ~7; block_x <= area.max_x; block_x += 8)
+        {
+            const i32 x_start = std::max(block_x, area.min_x);
+            const i32 x_end = std::min(block_x + 8, area.max_x + 1);
+
+            const i32 w0 = edge12(t, x_start, y_start);
+            const i32 w1 = edge20(t, x_start, y_start);
+            const i32 w2 = edge01(t, x_start, y_start);
+
+            // The extreme corner of each edge decides
+            const i32 dx = x_end - 1 - x_start;
+            const i32 dy = y_end - 1 - y_start;
+            const i32 w0_max = w0 + std::max(t.a12 * dx, 0) + std::max(t.b12 * dy, 0);
+            const i32 w1_max = w1 + std::max(t.a20 * dx, 0) + std::max(t.b20 * dy, 0);
+            const i32 w2_max = w2 + std::max(t.a01 * dx, 0) + std::max(t.b01 * dy, 0);
+            if (w0_max < 0 || w1_max < 0 || w2_max < 0)
+                continue;
+
+            const i32 w0_min = w0 + std::min(t.a12 * dx, 0) + std::min(t.b12 * dy, 0);
+            const i32 w1_min = w1 + std::min(t.a20 * dx, 0) + std::min(t.b20 * dy, 0);
+            const i32 w2_min = w2 + std::min(t.a01 * dx, 0) + std::min(t.b01 * dy, 0);
+            const bool covered = (w0_min | w1_min | w2_min) >= 0;
+
+            fn(x_start, x_end, y_start, y_end, covered, w0, w1, w2);
+        }
+    }
+}
+
+template<GU::TextureFormat Target, bool Blend>
+void VRasterizer::raster_fill_triangle(const Primitive& primitive, const Bounds& clip)
+{
+    TriangleSetup t;
+    Bounds area;
+    if (!setup_triangle(t, primitive, clip, area))
+        return;
+
+    for (u32 v = 0; v < 3; v++)
+    {
+        t.color[v][0] = primitive.v[v].color.r;
+        t.color[v][1] = primitive.v[v].color.g;
+        t.color[v][2] = primitive.v[v].color.b;
+    }
+
+    for (u32 channel = 0; channel < 3; channel++)
+    {
+        const i64 dx = i64(t.color[0][channel]) * t.a12 + i64(t.color[1][channel]) * t.a20 + i64(t.color[2][channel]) * t.a01;
+        const i64 dy = i64(t.color[0][channel]) * t.b12 + i64(t.color[1][channel]) * t.b20 + i64(t.color[2][channel]) * t.b01;
+        t.color_dx[channel] = i32((dx << 16) / t.denom);
+        t.color_dy[channel] = i32((dy << 16) / t.denom);
+    }
+
+    // The alpha is flat, taken from the first vertex. Replace writes it too,
+    // like rects and lines, so later DST_ALPHA blends read it
+    t.alpha = Word(primitive.v[0].color.a) << 24;
+
+    Word* pixels = (Word*)state.draw_buffer.address;
+    const i32 stride = state.draw_buffer.size.x;
+
+    for_each_block(t, area, [&](i32 x_start, i32 x_end, i32 y_start, i32 y_end, bool covered, i32 w0, i32 w1, i32 w2)
+    {
+        i32 r = color_at(t, 0, w0, w1, w2);
+        i32 g = color_at(t, 1, w0, w1, w2);
+        i32 b = color_at(t, 2, w0, w1, w2);
+
+        // The vector kernels only write RGBA8 without blending
+        if constexpr (Blend || Target != GU::TEXTURE_FORMAT_RGBA8)
+        {
+            for (i32 y = y_start; y < y_end; y++)
+            {
+                u8* row = target_pixel<Target>(0, y);
+                i32 e0 = w0, e1 = w1, e2 = w2;
+                i32 pr = r, pg = g, pb = b;
+                for (i32 x = x_start; x < x_end; x++)
+                {
+                    if (covered || (e0 | e1 | e2) >= 0)
+                    {
+                        write_pixel<Target, Blend>(row + x * VPixelFormat<Target>::Size, pack_color(pr, pg, pb, t.alpha), primitive.blend);
+                    }
+
+                    e0 += t.a12;
+                    e1 += t.a20;
+                    e2 += t.a01;
+                    pr += t.color_dx[0];
+                    pg += t.color_dx[1];
+                    pb += t.color_dx[2];
+                }
+
+                w0 += t.b12;
+                w1 += t.b20;
+                w2 += t.b01;
+                r += t.color_dy[0];
+                g += t.color_dy[1];
+                b += t.color_dy[2];
+            }
+            return;
+        }
+
+        if (x_end - x_start == 8)
+        {
+            triangle_block<RasterLanes>(t, pixels + y_start * stride + x_start, stride, y_end - y_start, covered, w0, w1, w2, r, g, b);
+            return;
+        }
+
+        for (i32 y = y_start; y < y_end; y++)
+        {
+            triangle_span<RasterLanes>(t, pixels + y * stride, x_start, x_end, covered, w0, w1, w2, r, g, b);
+
+            w0 += t.b12;
+            w1 += t.b20;
+            w2 += t.b01;
+            r += t.color_dy[0];
+            g += t.color_dy[1];
+            b += t.color_dy[2];
+        }
+    });
+}
+
+// Clamp addressing, the format is fixed at compile time
+template<GU::TextureFormat Format>
+static FORCE_INLINE Word fetch_texel(const VRasterizer::TextureView& texture, i32 x, i32 y)
+{
+    x = std::clamp(x, 0, texture.width - 1);
+    y = std::clamp(y, 0, texture.height - 1);
+    return VPixelFormat<Format>::load(texture.texels + (usize(y) * texture.width + x) * VPixelFormat<Format>::Size);
+}
+
+// t in [0, 256], two channels per multiply
+static FORCE_INLINE Word lerp_texel(Word a, Word b, Word t)
+{
+    const Word rb = ((a & 0x00FF'00FF) * (256 - t) + (b & 0x00FF'00FF) * t) >> 8;
+    const Word ga = (((a >> 8) & 0x00FF'00FF) * (256 - t) + ((b >> 8) & 0x00FF'00FF) * t) >> 8;
+    return (rb & 0x00FF'00FF) | ((ga & 0x00FF'00FF) << 8);
+}
+
+// u and v are 16.16 texels
+template<GU::TextureFormat Format, bool Bilinear>
+static FORCE_INLINE Word sample_texture(const VRasterizer::TextureView& texture, i64 u, i64 v)
+{
+    // Past the edges every sample is the border texel, keeps the math in 32 bits
+    u = std::clamp<i64>(u, -(1 << 16), i64(texture.width + 1) << 16);
+    v = std::clamp<i64>(v, -(1 << 16), i64(texture.height + 1) << 16);
+
+    if constexpr (!Bilinear)
+    {
+        return fetch_texel<Format>(texture, i32(u >> 16), i32(v >> 16));
+    }
+    else
+    {
+        // Texel centres are at .5
+        const i32 su = i32(u) - 0x8000;
+        const i32 sv = i32(v) - 0x8000;
+        const i32 x = su >> 16;
+        const i32 y = sv >> 16;
+        const Word fu = Word(su >> 8) & 0xFF;
+        const Word fv = Word(sv >> 8) & 0xFF;
+
+        const Word top = lerp_texel(fetch_texel<Format>(texture, x, y), fetch_texel<Format>(texture, x + 1, y), fu);
+        const Word bottom = lerp_texel(fetch_texel<Format>(texture, x, y + 1), fetch_texel<Format>(texture, x + 1, y + 1), fu);
+        return lerp_texel(top, bottom, fv);
+    }
+}
+
+// 16.16 attribute at the edge values w, and its steps for x++ and y++
+static FORCE_INLINE i64 attribute_at(const TriangleSetup& t, const i32* a, i32 w0, i32 w1, i32 w2)
+{
+    return (i64(a[0]) * w0 + i64(a[1]) * w1 + i64(a[2]) * w2) / t.denom;
+}
+
+static FORCE_INLINE i64 attribute_dx(const TriangleSetup& t, const i32* a) { return attribute_at(t, a, t.a12, t.a20, t.a01); }
+static FORCE_INLINE i64 attribute_dy(const TriangleSetup& t, const i32* a) { return attribute_at(t, a, t.b12, t.b20, t.b01); }
+
+template<GU::TextureFormat Target, GU::TextureFormat Format, bool Bilinear, bool Blend>
+static void raster_textured_triangle(const VRasterizer::Primitive& primitive, const VRasterizer::Bounds& clip)
+{
+    TriangleSetup t;
+    VRasterizer::Bounds area;
+    if (!setup_triangle(t, primitive, clip, area))
+        return;
+
+    const i32 us[3] = { primitive.uv[0].x, primitive.uv[1].x, primitive.uv[2].x };
+    const i32 vs[3] = { primitive.uv[0].y, primitive.uv[1].y, primitive.uv[2].y };
+    const i64 u_dx = attribute_dx(t, us), u_dy = attribute_dy(t, us);
+    const i64 v_dx = attribute_dx(t, vs), v_dy = attribute_dy(t, vs);
+
+    const VRasterizer::TextureView& texture = primitive.texture;
+
+    for_each_block(t, area, [&](i32 x_start, i32 x_end, i32 y_start, i32 y_end, bool covered, i32 w0, i32 w1, i32 w2)
+    {
+        // Sampled at the pixel centre
+        i64 u = attribute_at(t, us, w0, w1, w2) + (u_dx + u_dy) / 2;
+        i64 v = attribute_at(t, vs, w0, w1, w2) + (v_dx + v_dy) / 2;
+
+        for (i32 y = y_start; y < y_end; y++)
+        {
+            u8* row = target_pixel<Target>(0, y);
+            i32 e0 = w0, e1 = w1, e2 = w2;
+            i64 pu = u, pv = v;
+            for (i32 x = x_start; x < x_end; x++)
+            {
+                if (covered || (e0 | e1 | e2) >= 0)
+                {
+                    write_pixel<Target, Blend>(row + x * VPixelFormat<Target>::Size, sample_texture<Format, Bilinear>(texture, pu, pv), primitive.blend);
+                }
+
+                e0 += t.a12;
+                e1 += t.a20;
+                e2 += t.a01;
+                pu += u_dx;
+                pv += v_dx;
+            }
+
+            w0 += t.b12;
+            w1 += t.b20;
+            w2 += t.b01;
+            u += u_dy;
+            v += v_dy;
+        }
+    });
+}
+
+template<GU::TextureFormat Target, GU::TextureFormat Format, bool Bilinear, bool Blend>
+static void raster_sprite(const VRasterizer::Primitive& primitive, const VRasterizer::Bounds& clip)
+{
+    const i32 min_x = std::max(primitive.bounds.min_x, clip.min_x);
+    const i32 max_x = std::min(primitive.bounds.max_x, clip.max_x);
+    const i32 min_y = std::max(primitive.bounds.min_y, clip.min_y);
+    const i32 max_y = std::min(primitive.bounds.max_y, clip.max_y);
+    if (min_x >= max_x || min_y >= max_y)
+        return;
+
+    const i64 u_step = primitive.uv[1].x;
+    const i64 v_step = primitive.uv[1].y;
+    const i64 u_start = primitive.uv[0].x + (min_x - primitive.bounds.min_x) * u_step;
+    i64 v = primitive.uv[0].y + (min_y - primitive.bounds.min_y) * v_step;
+
+    u8* row = target_pixel<Target>(min_x, min_y);
+    for (i32 y = min_y; y < max_y; y++, row += VRasterizer::state.draw_buffer.stride, v += v_step)
+    {
+        i64 u = u_start;
+        for (i32 x = 0; x < max_x - min_x; x++, u += u_step)
+        {
+            write_pixel<Target, Blend>(row + x * VPixelFormat<Target>::Size, sample_texture<Format, Bilinear>(primitive.texture, u, v), primitive.blend);
+        }
+    }
+}
+
+static void raster_sprite_copy(const VRasterizer::Primitive& primitive, const VRasterizer::Bounds& clip)
+{
+    const i32 min_x = std::max(primitive.bounds.min_x, clip.min_x);
+    const i32 max_x = std::min(primitive.bounds.max_x, clip.max_x);
+    const i32 min_y = std::max(primitive.bounds.min_y, clip.min_y);
+    const i32 max_y = std::min(primitive.bounds.max_y, clip.max_y);
+    if (min_x >= max_x || min_y >= max_y)
+        return;
+
+    // The texture has the draw buffer format
+    const usize pixel_size = TexelSize[VRasterizer::state.draw_buffer.format];
+    const i32 texel_x = (primitive.uv[0].x >> 16) + min_x - primitive.bounds.min_x;
+    const i32 texel_y = (primitive.uv[0].y >> 16) + min_y - primitive.bounds.min_y;
+    const u8* texels = primitive.texture.texels + (usize(texel_y) * primitive.texture.width + texel_x) * pixel_size;
+
+    u8* row = (u8*)VRasterizer::state.draw_buffer.address + usize(min_y) * VRasterizer::state.draw_buffer.stride + min_x * pixel_size;
+    for (i32 y = min_y; y < max_y; y++)
+    {
+        std::memcpy(row, texels, usize(max_x - min_x) * pixel_size);
+        row += VRasterizer::state.draw_buffer.stride;
+        texels += primitive.texture.width * pixel_size;
+    }
+}
+
+// [target][format][bilinear][blend]
+#define TEXTURED_FNS(fn, target, format) \
+    { \
+        { &fn<target, format, false, false>, &fn<target, format, false, true> }, \
+        { &fn<target, format, true, false>, &fn<target, format, true, true> }, \
+    }
+
+#define TEXTURED_FORMATS(fn, target) \
+    { \
+        TEXTURED_FNS(fn, target, GU::TEXTURE_FORMAT_RGBA8), \
+        TEXTURED_FNS(fn, target, GU::TEXTURE_FORMAT_RGB8), \
+        TEXTURED_FNS(fn, target, GU::TEXTURE_FORMAT_RGBA4), \
+        TEXTURED_FNS(fn, target, GU::TEXTURE_FORMAT_RGB565), \
+        TEXTURED_FNS(fn, target, GU::TEXTURE_FORMAT_RGBA5551), \
+    }
+
+#define TEXTURED_TARGETS(fn) \
+    { \
+        TEXTURED_FORMATS(fn, GU::TEXTURE_FORMAT_RGBA8), \
+        TEXTURED_FORMATS(fn, GU::TEXTURE_FORMAT_RGB8), \
+        TEXTURED_FORMATS(fn, GU::TEXTURE_FORMAT_RGBA4), \
+        TEXTURED_FORMATS(fn, GU::TEXTURE_FORMAT_RGB565), \
+        TEXTURED_FORMATS(fn, GU::TEXTURE_FORMAT_RGBA5551), \
+    }
+
+using TexturedFnTable = VRasterizer::RasterFn[GU::TEXTURE_FORMAT_COUNT][GU::TEXTURE_FORMAT_COUNT][2][2];
+static constexpr TexturedFnTable TexturedTriangleFns = TEXTURED_TARGETS(raster_textured_triangle);
+static constexpr TexturedFnTable SpriteFns = TEXTURED_TARGETS(raster_sprite);
+
+#undef TEXTURED_TARGETS
+#undef TEXTURED_FORMATS
+#undef TEXTURED_FNS
+
+bool VRasterizer::get_texture(u32 texture_unit, TextureView& view, GU::TextureFormat& format)
+{
+    if (texture_unit >= std::size(VGU::get_state().texture_units))
+        return false;
+
+    const VGU::TMU& tmu = VGU::get_state().texture_units[texture_unit];
+    if (tmu.texture_format >= GU::TEXTURE_FORMAT_COUNT || tmu.width == 0 || tmu.height == 0)
+        return false;
+
+    format = GU::TextureFormat(tmu.texture_format);
+    if (!VGU::check_vram_range(tmu.texture_address, Word(tmu.width) * tmu.height * TexelSize[format]))
+        return false;
+
+    view.texels = (const u8*)tmu.cache_texture_address;
+    view.width = tmu.width;
+    view.height = tmu.height;
+    return true;
+}
+
+static bool use_bilinear(u32 texture_unit, bool minified)
+{
+    const VGU::TMU& tmu = VGU::get_state().texture_units[texture_unit];
+    return (minified ? tmu.min_filter : tmu.mag_filter) == GU::TEXTURE_FILTER_BILINEAR;
+}
+
+void VRasterizer::textured_triangle(VertexUV v0, VertexUV v1, VertexUV v2, u32 texture_unit)
+{
+    Primitive primitive = {};
+    GU::TextureFormat format;
+    if (!get_texture(texture_unit, primitive.texture, format))
+        return;
+
+    const VertexUV vertices[3] = { v0, v1, v2 };
+    for (u32 i = 0; i < 3; i++)
+    {
+        primitive.v[i].position = vertices[i].position;
+        primitive.uv[i] = Vector2I(i32(vertices[i].uv.x * 65536.0f), i32(vertices[i].uv.y * 65536.0f));
+    }
+
+    // More texels than pixels under the triangle is a minification
+    const f32 pixel_area = std::abs((v1.position.x - v0.position.x) * (v2.position.y - v0.position.y) -
+        (v2.position.x - v0.position.x) * (v1.position.y - v0.position.y));
+    const f32 texel_area = std::abs((v1.uv.x - v0.uv.x) * (v2.uv.y - v0.uv.y) -
+        (v2.uv.x - v0.uv.x) * (v1.uv.y - v0.uv.y));
+
+    primitive.raster = TexturedTriangleFns[state.draw_buffer.format][format][use_bilinear(texture_unit, texel_area > pixel_area)][state.blending];
+    bin_triangle(primitive);
+}
+
+void VRasterizer::sprite(Vector2I position, Vector2I size, Vector2I uv, Vector2I uv_size, u32 texture_unit)
+{
+    if (size.x <= 0 || size.y <= 0)
+        return;
+
+    Primitive primitive = {};
+    GU::TextureFormat format;
+    if (!get_texture(texture_unit, primitive.texture, format))
+        return;
+
+    primitive.bounds = { position.x, position.y, position.x + size.x, position.y + size.y };
+
+    // Keeps the 16.16 source coordinates in range, past the texture it's all border
+    uv = Vector2I(std::min(uv.x, i32(0x1000)), std::min(uv.y, i32(0x1000)));
+    uv_size = Vector2I(std::min(uv_size.x, i32(0x1000)), std::min(uv_size.y, i32(0x1000)));
+
+    // uv[1] is the 16.16 step per pixel, uv[0] the sample at the first pixel centre
+    primitive.uv[1] = Vector2I(i32((i64(uv_size.x) << 16) / size.x), i32((i64(uv_size.y) << 16) / size.y));
+    primitive.uv[0] = Vector2I((uv.x << 16) + primitive.uv[1].x / 2, (uv.y << 16) + primitive.uv[1].y / 2);
+
+    const bool minified = uv_size.x > size.x || uv_size.y > size.y;
+    const bool bilinear = use_bilinear(texture_unit, minified);
+
+    // A 1:1 sprite inside a texture of the draw buffer format is a copy of its rows
+    const bool inside = uv.x + size.x <= primitive.texture.width && uv.y + size.y <= primitive.texture.height;
+    if (format == state.draw_buffer.format && !bilinear && !state.blending && uv_size.x == size.x && uv_size.y == size.y && inside)
+        primitive.raster = &raster_sprite_copy;
+    else
+        primitive.raster = SpriteFns[state.draw_buffer.format][format][bilinear][state.blending];
+
+    bin(primitive);
 }
 
+void VRasterizer::draw_batch(GU::Topology topology, Word first, Word count, bool indexed, u32 texture_unit)
+{
+    if (state.put_pixel == PP_NONE)
+        return;
+
+    // Draws past the end of a buffer are dropped
+    const Word source_count = indexed ? state.index_buffer.count : state.vertex_buffer.count;
+    if (first > source_count || count > source_count - first || count < 3)
+        return;
+
+    const u16* indices = indexed ? state.index_buffer.indices + first : nullptr;
+    const bool restart = indexed && topology == GU::TOPOLOGY_TRIANGLE_STRIP;
+
+    // Every vertex in the referenced range is decoded once
+    Word min_index = first;
+    Word max_index = first + count - 1;
+    if (indexed)
+    {
+        min_index = 0xFFFF'FFFF;
+        max_index = 0;
+        for (Word i = 0; i < count; i++)
+        {
+            if (restart && indices[i] == RestartIndex)
+                continue;
+
+            min_index = std::min<Word>(min_index, indices[i]);
+            max_index = std::max<Word>(max_index, indices[i]);
+        }
+
+        if (min_index > max_index)
+            return;
+    }
+
+    if (max_index >= state.vertex_buffer.count)
+        return;
+
+    const GU::VertexFormat vertex_format = state.vertex_buffer.format;
+    const Word* words = state.vertex_buffer.words + usize(min_index) * VertexWords[vertex_format];
+
+    std::vector<BatchVertex>& vertices = state.batch_vertices;
+    vertices.resize(max_index - min_index + 1);
+    for (BatchVertex& vertex : vertices)
+    {
+        vertex.vertex.position = Vector2(words[0] & 0xFFFF, words[0] >> 16);
+        if (vertex_format == GU::VERTEX_FORMAT_COLOR)
+        {
+            vertex.vertex.color.rgba = words[1];
+        }
+        else
+        {
+            // 12.4 to 16.16
+            vertex.uv = Vector2I(i32(words[1] & 0xFFFF) << 12, i32(words[1] >> 16) << 12);
+        }
+
+        words += VertexWords[vertex_format];
+    }
+
+    // The raster functions are picked once for the batch
+    Primitive primitive = {};
+    const RasterFn (*textured_fns)[2] = nullptr;
+    if (vertex_format == GU::VERTEX_FORMAT_UV)
+    {
+        GU::TextureFormat texture_format;
+        if (!get_texture(texture_unit, primitive.texture, texture_format))
+            return;
+
+        textured_fns = TexturedTriangleFns[state.draw_buffer.format][texture_format];
+    }
+    else
+    {
+        primitive.raster = FillTriangleFns[state.draw_buffer.format][state.blending];
+    }
+
+    const auto emit = [&](const BatchVertex& v0, const BatchVertex& v1, const BatchVertex& v2)
+    {
+        const BatchVertex* batch[3] = { &v0, &v1, &v2 };
+        for (u32 i = 0; i < 3; i++)
+        {
+            primitive.v[i] = batch[i]->vertex;
+            primitive.uv[i] = batch[i]->uv;
+        }
+
+        if (textured_fns)
+        {
+            // Same minification test as textured_triangle, the uvs are 16.16
+            const f32 pixel_area = std::abs((v1.vertex.position.x - v0.vertex.position.x) * (v2.vertex.position.y - v0.vertex.position.y) -
+                (v2.vertex.position.x - v0.vertex.position.x) * (v1.vertex.position.y - v0.vertex.position.y));
+            const f32 texel_area = std::abs(f32(i64(v1.uv.x - v0.uv.x) * (v2.uv.y - v0.uv.y) -
+                i64(v2.uv.x - v0.uv.x) * (v1.uv.y - v0.uv.y))) / (65536.0f * 65536.0f);
+
+            primitive.raster = textured_fns[use_bilinear(texture_unit, texel_area > pixel_area)][state.blending];
+        }
+
+        bin_triangle(primitive);
+    };
+
+    const auto vertex = [&](Word i) -> const BatchVertex& { return vertices[(indexed ? indices[i] : first + i) - min_index]; };
+
+    if (topology == GU::TOPOLOGY_TRIANGLE_LIST)
+    {
+        for (Word i = 0; i + 3 <= count; i += 3)
+        {
+            emit(vertex(i), vertex(i + 1), vertex(i + 2));
+        }
+        return;
+    }
+
+    // Nothing is culled, so the winding of odd strip triangles doesn't matter
+    Word strip_len = 0;
+    for (Word i = 0; i < count; i++)
+    {
+        if (restart && indices[i] == RestartIndex)
+        {
+            strip_len = 0;
+            continue;
+        }
+
+        if (++strip_len >= 3)
+        {
+            emit(vertex(i - 2), vertex(i - 1), vertex(i));
+        }
+    }
+}
@@ -5,16 +5,34 @@
 /*        See the LICENSE in the project root.        */
 /******************************************************/
 #pragma once
+#include "Core/ThreadPool.h"
 #include "Video/GUDevice.h"
 #include "Video/Math.h"
 
+#include <vector>
+
 
 struct VRasterizer
 {
+	// Primitives are binned in square tiles of the draw buffer, tiles are
+	// rasterized in parallel and each one keeps the submission order
+	static constexpr i32 TileShift = 5;
+	static constexpr i32 TileSize = 1 << TileShift;
+	static constexpr u32 MaxRasterThreads = 16;
+	// Triangles are clipped to [-GuardBand, GuardBand] before binning, so
+	// their i32 edge functions can't overflow
+	static constexpr i32 GuardBand = 1 << 13;
+	// Bounds the bins of a long command list
+	static constexpr usize MaxBinnedPrimitives = 1 << 16;
+	// In words, indexed by GU::VertexFormat
+	static constexpr Word VertexWords[GU::VERTEX_FORMAT_COUNT] = { 2, 2 };
+	static constexpr u16 RestartIndex = 0xFFFF;
+
 	enum PutPixel
 	{
 		PP_NONE,
-		PP_RGBA8,
+		// Pixels are stored in draw_buffer.format
+		PP_DRAW_BUFFER,
 	};
 
 	struct VertexColor
@@ -23,6 +41,79 @@ struct VRasterizer
 		Color color;
 	};
 
+	struct VertexUV
+	{
+		Vector2 position;
+		// In texels
+		Vector2 uv;
+	};
+
+	// Texture unit state captured when a primitive is binned
+	struct TextureView
+	{
+		const u8* texels;
+		i32 width;
+		i32 height;
+	};
+
+	// In pixels, max is exclusive
+	struct Bounds
+	{
+		i32 min_x;
+		i32 min_y;
+		i32 max_x;
+		i32 max_y;
+	};
+
+	struct BlendState
+	{
+		GU::BlendFactor src_factor;
+		GU::BlendFactor dst_factor;
+		GU::AlphaTest alpha_test;
+		u8 alpha_reference;
+		// GU::WriteMask
+		u8 write_mask;
+		// Alpha of untextured primitives
+		u8 color_alpha;
+	};
+
+	// Blend state resolved for the inner loops, factors are
+	// constant + src_alpha * [1] + dst_alpha * [2]
+	struct BlendOp
+	{
+		i32 src_factor[3];
+		i32 dst_factor[3];
+		// The alpha test passes in [min, max]
+		i32 alpha_min;
+		i32 alpha_max;
+		Word write_mask;
+	};
+
+	// Decoded once per batch, shared by the triangles that use it
+	struct BatchVertex
+	{
+		VertexColor vertex;
+		// 16.16 texels
+		Vector2I uv;
+	};
+
+	struct Primitive;
+	// Picked when the primitive is binned, so tiles don't look at the state
+	using RasterFn = void(*)(const Primitive& primitive, const Bounds& clip);
+
+	struct Primitive
+	{
+		RasterFn raster;
+		Bounds bounds;
+		VertexColor v[3];
+
+		// Textured primitives, 16.16 texels
+		Vector2I uv[3];
+		TextureView texture;
+
+		BlendOp blend;
+	};
+
 	struct RasterizerState
 	{
 		struct
@@ -31,12 +122,42 @@ struct VRasterizer
 			Vector2I size;
 			Vector2I offset;
 			GU::TextureFormat format;
+			// In bytes
+			i32 stride;
 		} draw_buffer;
 
 		PutPixel put_pixel;
+
+		BlendState blend;
+		BlendOp blend_op;
+		// Anything but a plain replace
+		bool blending;
+
+		struct
+		{
+			const Word* words;
+			Word count;
+			GU::VertexFormat format;
+		} vertex_buffer;
+
+		struct
+		{
+			const u16* indices;
+			Word count;
+		} index_buffer;
+
+		std::vector<BatchVertex> batch_vertices;
+
+		std::vector<Primitive> primitives;
+		// Primitive indices of every tile, in submission order
+		std::vector<std::vector<u32>> tile_bins;
+		std::vector<u32> busy_tiles;
+		i32 tiles_x;
+		i32 tiles_y;
 	};
 
 	static inline RasterizerState state;
+	static inline ThreadPool workers;
 
 	[[nodiscard]] static RasterizerState& get_state() { return state; }
 
@@ -45,16 +166,36 @@ struct VRasterizer
 
 	static void reset_state();
 
-	static void pixel_default(Vector2I, Color) {}
-	static void pixel(Vector2I position, Color rgb);
-	static void pixel_line(Vector2I position, i32 width, Color rgb);
-
 	static void set_draw_buffer(PhysicalAddress address, Vector2I size, 
 		Vector2I offset, GU::TextureFormat format);
 
+	static bool set_blend_state(const BlendState& blend);
+	static void set_vertex_buffer(PhysicalAddress address, Word count, GU::VertexFormat format);
+	static void set_index_buffer(PhysicalAddress address, Word count);
+
+	static void clear(Color color);
 	static void line(VertexColor p0, VertexColor p1);
 	static void rect(Vector2 position, Vector2 size, Color color);
 	static void fill_rect(Vector2 position, Vector2 size, Color color);
 	static void triangle(VertexColor v0, VertexColor v1, VertexColor v2);
 	static void fill_triangle(VertexColor v0, VertexColor v1, VertexColor v2);
+	static void textured_triangle(VertexUV v0, VertexUV v1, VertexUV v2, u32 texture_unit);
+	static void sprite(Vector2I position, Vector2I size, Vector2I uv, Vector2I uv_size, u32 texture_unit);
+	// count vertices from first, or count indices from first when indexed
+	static void draw_batch(GU::Topology topology, Word first, Word count, bool indexed, u32 texture_unit);
+
+	// Rasterizes everything binned so far
+	static void flush();
+
+	static void bin(const Primitive& primitive);
+	static void bin_triangle(Primitive& primitive);
+	static bool get_texture(u32 texture_unit, TextureView& view, GU::TextureFormat& format);
+	static void rasterize_tile(u32 tile);
+	// Instantiated for every draw buffer format
+	template<GU::TextureFormat Target, bool Blend>
+	static void raster_line(const Primitive& primitive, const Bounds& clip);
+	template<GU::TextureFormat Target, bool Blend>
+	static void raster_fill_rect(const Primitive& primitive, const Bounds& clip);
+	template<GU::TextureFormat Target, bool Blend>
+	static void raster_fill_triangle(const Primitive& primitive, const Bounds& clip);
 };
\ No newline at end of file
@@ -8,6 +8,7 @@
 
 #include "Platform/Header.h"
 #include "IO/Pad/Pad.h"
+#include "Memory/MemoryProfiler.h"
 
 Pad::PadButton buttons_map[256] = {};
 
@@ -31,6 +32,10 @@ LRESULT wnd_proc(HWND wnd, UINT msg, WPARAM wp, LPARAM lp)
         break;
     case WM_KEYDOWN:
     case WM_KEYUP:
+#if NGP_MEMORY_PROFILER
+        if (wp == VK_F9 && msg == WM_KEYDOWN)
+            MemoryProfiler::request_dump();
+#endif // NGP_MEMORY_PROFILER
         Pad::update(0, _wp_to_buttons(wp), msg == WM_KEYDOWN);
         break;
     }
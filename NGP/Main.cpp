@@ -4,10 +4,15 @@
 /*       Copyright (c) 2024-Present Jake-Insene       */
 /*        See the LICENSE in the project root.        */
 /******************************************************/
+#include "IO/Pad/Pad.h"
+#include "IO/SPU/SPU.h"
+#include "IO/USI/USI.h"
 #include "Memory/Bus.h"
+#include "Memory/MemoryProfiler.h"
 #include "Emulator.h"
 
 #include <cstdio>
+#include <cstdlib>
 #include <string>
 
 EmulatorConfig config =
@@ -24,6 +29,13 @@ void print_help()
         "options:\n"
         "\t-help show this help\n"
         "\t-bios <path> set the bios file\n"
+        "\t-map-bios map the bios file copy-on-write instead of copying it\n"
+        "\t-disk <path> insert a NGPFS disk image in the USI port\n"
+        "\t-audio <path> write the SPU output to a WAV file, 'null' to discard it\n"
+        "\t-watch <address> <size> trap guest writes to the range\n"
+        "\t-watch-rw <address> <size> trap guest reads and writes to the range\n"
+        "\t-memprof <path> write the memory access profile (.csv or .json) at exit, F9 or SIGUSR1 write it on demand\n"
+        "\t-pad-latency print the input to present latency histogram at exit\n"
     );
 }
 
@@ -59,6 +71,61 @@ void handle_arguments(int argc, char** argv)
             }
             Emulator::bios_file = argv[index++];
         }
+        else if (arg == "disk")
+        {
+            if (index == argc)
+            {
+                printf("error: -disk require a path");
+                exit(1);
+            }
+            USI::disk_path = argv[index++];
+        }
+        else if (arg == "audio")
+        {
+            if (index == argc)
+            {
+                printf("error: -audio require a path");
+                exit(1);
+            }
+            SPU::output_path = argv[index++];
+        }
+        else if (arg == "map-bios")
+        {
+            Emulator::map_bios_file = true;
+        }
+        else if (arg == "watch" || arg == "watch-rw")
+        {
+            if (index + 1 >= argc)
+            {
+                printf("error: -%s require an address and a size", arg.c_str());
+                exit(1);
+            }
+
+            VirtualAddress address = VirtualAddress(std::strtoul(argv[index++], nullptr, 0));
+            Word size = Word(std::strtoul(argv[index++], nullptr, 0));
+            Bus::PageAccess access = arg == "watch" ? Bus::PageWrite : Bus::PageAccess(Bus::PageRead | Bus::PageWrite);
+            if (!Bus::add_watchpoint(address, size, access))
+            {
+                printf("error: invalid watch range 0x%08X, 0x%X\n", address, size);
+                exit(1);
+            }
+        }
+        else if (arg == "memprof")
+        {
+            if (index == argc)
+            {
+                printf("error: -memprof require a path");
+                exit(1);
+            }
+            MemoryProfiler::dump_path = argv[index++];
+#if !NGP_MEMORY_PROFILER
+            printf("warning: the memory profiler is not enabled in this build (NGP_MEMORY_PROFILER)\n");
+#endif // !NGP_MEMORY_PROFILER
+        }
+        else if (arg == "pad-latency")
+        {
+            Pad::print_latency = true;
+        }
         else if (arg == "jit")
         {
             config.impl_type = CPUCore::ImplementationType::JIT;
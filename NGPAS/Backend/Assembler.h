@@ -131,6 +131,7 @@ struct Assembler
 
     // assemble_instruction();
     void assemble_load_store(u32& inst, u8 imm_opcode, u8 index_opc, u8 alignment, bool handle_symbol);
+    void assemble_exclusive(u32& inst, u8 opc, bool has_source);
     void assemble_binary(u32& inst, u8 opc, u8 opc_imm, u16 immediate_limit);
     void assemble_fbinary(u32& inst, u8 s_opc, u8 v_s4_opc);
     void assemble_comparison(u32& inst, u8 opc, u8 opc_imm, u16 immediate_limit);
@@ -635,6 +635,18 @@ void Assembler::assemble_instruction()
     case TI_STB:
         assemble_load_store(inst, NGP_STB_IMMEDIATE, NGP_STB, 1, false);
         break;
+    case TI_LDX:
+        assemble_exclusive(inst, NGP_LDX, false);
+        break;
+    case TI_STX:
+        assemble_exclusive(inst, NGP_STX, true);
+        break;
+    case TI_SWP:
+        assemble_exclusive(inst, NGP_SWP, true);
+        break;
+    case TI_CAS:
+        assemble_exclusive(inst, NGP_CAS, true);
+        break;
     case TI_MADD:
         assemble_three_operands(inst, [](u8 dest, u8 src1, u8 src2, u8 src3)
             {
@@ -1054,6 +1066,35 @@ void Assembler::assemble_load_store(u32& inst, u8 imm_opcode,
     }
 }
 
+void Assembler::assemble_exclusive(u32& inst, u8 opc, bool has_source)
+{
+    u16 dest;
+    if (!try_get_register(dest, RegisterGP, "expected destination register"))
+        return;
+    if (!expected_comma())
+        return;
+
+    u16 src = ZeroRegister;
+    if (has_source)
+    {
+        if (!try_get_register(src, RegisterGP, "expected source register"))
+            return;
+        if (!expected_comma())
+            return;
+    }
+
+    if (!expected_left_key())
+        return;
+
+    u16 base;
+    if (!try_get_register(base, RegisterGP, "expected base register"))
+        return;
+    if (!expected_right_key())
+        return;
+
+    inst = inst_3op(opc, dest, base, src);
+}
+
 void Assembler::assemble_binary(u32& inst, u8 opc, u8 opc_imm, u16 immediate_limit)
 {
     u16 dest;
@@ -233,6 +233,11 @@ SymbolInfo symbols[] =
     {.symbol = "sth", .size = 3, .type = TOKEN_INSTRUCTION, .subtype = TI_STH },
     {.symbol = "stb", .size = 3, .type = TOKEN_INSTRUCTION, .subtype = TI_STB },
 
+    {.symbol = "ldx", .size = 3, .type = TOKEN_INSTRUCTION, .subtype = TI_LDX },
+    {.symbol = "stx", .size = 3, .type = TOKEN_INSTRUCTION, .subtype = TI_STX },
+    {.symbol = "swp", .size = 3, .type = TOKEN_INSTRUCTION, .subtype = TI_SWP },
+    {.symbol = "cas", .size = 3, .type = TOKEN_INSTRUCTION, .subtype = TI_CAS },
+
     {.symbol = "tbz", .size = 3, .type = TOKEN_INSTRUCTION, .subtype = TI_TBZ },
     {.symbol = "tbnz", .size = 4, .type = TOKEN_INSTRUCTION, .subtype = TI_TBNZ },
     {.symbol = "cbz", .size = 3, .type = TOKEN_INSTRUCTION, .subtype = TI_CBZ },
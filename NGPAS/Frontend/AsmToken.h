@@ -292,6 +292,11 @@ enum AsmTokenInstruction : u8
     TI_STH,
     TI_STB,
 
+    TI_LDX,
+    TI_STX,
+    TI_SWP,
+    TI_CAS,
+
     TI_TBZ,
     TI_TBNZ,
 